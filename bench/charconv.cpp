@@ -0,0 +1,234 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+#include <ekutil/charconv.h>
+#include <ekutil/small_vector.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#if EKUTIL_HAS_INTEGER_CHARCONV
+#include <charconv>
+#endif
+
+// A column of 64 Ki comma-separated numbers of up to `digits` digits
+static std::string make_column(int digits)
+{
+    std::mt19937_64 rng(42);
+    uint64_t mod = 1;
+    for (int i = 0; i < digits && i < 19; ++i) {
+        mod *= 10;
+    }
+    std::string column;
+    for (int i = 0; i < (64 << 10); ++i) {
+        column += std::to_string(digits < 20 ? rng() % mod : rng());
+        column += ',';
+    }
+    return column;
+}
+
+static void parse_uint64_strtoull(benchmark::State& state)
+{
+    auto column = make_column(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        const char* p = column.data();
+        const char* last = p + column.size();
+        while (p != last) {
+            char* end;
+            sum += std::strtoull(p, &end, 10);
+            p = end + 1;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(column.size()));
+}
+BENCHMARK(parse_uint64_strtoull)->Arg(3)->Arg(8)->Arg(20);
+
+#if EKUTIL_HAS_INTEGER_CHARCONV
+static void parse_uint64_std(benchmark::State& state)
+{
+    auto column = make_column(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        const char* p = column.data();
+        const char* last = p + column.size();
+        while (p != last) {
+            uint64_t v = 0;
+            p = std::from_chars(p, last, v).ptr + 1;
+            sum += v;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(column.size()));
+}
+BENCHMARK(parse_uint64_std)->Arg(3)->Arg(8)->Arg(20);
+#endif
+
+static void parse_uint64(benchmark::State& state)
+{
+    auto column = make_column(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        const char* p = column.data();
+        const char* last = p + column.size();
+        while (p != last) {
+            uint64_t v = 0;
+            p = ekutil::from_chars(p, last, v).ptr + 1;
+            sum += v;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(column.size()));
+}
+BENCHMARK(parse_uint64)->Arg(3)->Arg(8)->Arg(20);
+
+static void parse_uint64_column(benchmark::State& state)
+{
+    auto column = make_column(static_cast<int>(state.range(0)));
+    std::vector<uint64_t> values(64 << 10);
+    for (auto _ : state) {
+        auto r = ekutil::from_chars_column(
+            ekutil::string_view(column.data(), column.size()), ',',
+            ekutil::make_span(values.data(), values.data() + values.size()));
+        benchmark::DoNotOptimize(r.count);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(column.size()));
+}
+BENCHMARK(parse_uint64_column)->Arg(3)->Arg(8)->Arg(20);
+
+// 4 Ki counters, of up to `digits` digits
+static std::vector<uint64_t> make_counters(int digits)
+{
+    std::mt19937_64 rng(42);
+    uint64_t mod = 1;
+    for (int i = 0; i < digits && i < 19; ++i) {
+        mod *= 10;
+    }
+    std::vector<uint64_t> counters(4 << 10);
+    for (auto& c : counters) {
+        c = digits < 20 ? rng() % mod : rng();
+    }
+    return counters;
+}
+
+static void format_uint64_snprintf(benchmark::State& state)
+{
+    auto counters = make_counters(static_cast<int>(state.range(0)));
+    char buf[32];
+    for (auto _ : state) {
+        for (auto c : counters) {
+            benchmark::DoNotOptimize(std::snprintf(
+                buf, sizeof(buf), "%llu", static_cast<unsigned long long>(c)));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(counters.size()));
+}
+BENCHMARK(format_uint64_snprintf)->Arg(3)->Arg(8)->Arg(20);
+
+#if EKUTIL_HAS_INTEGER_CHARCONV
+static void format_uint64_std(benchmark::State& state)
+{
+    auto counters = make_counters(static_cast<int>(state.range(0)));
+    char buf[32];
+    for (auto _ : state) {
+        for (auto c : counters) {
+            benchmark::DoNotOptimize(
+                std::to_chars(buf, buf + sizeof(buf), c).ptr);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(counters.size()));
+}
+BENCHMARK(format_uint64_std)->Arg(3)->Arg(8)->Arg(20);
+#endif
+
+static void format_uint64(benchmark::State& state)
+{
+    auto counters = make_counters(static_cast<int>(state.range(0)));
+    char buf[ekutil::max_chars<uint64_t>()];
+    for (auto _ : state) {
+        for (auto c : counters) {
+            benchmark::DoNotOptimize(
+                ekutil::to_chars(buf, buf + sizeof(buf), c).ptr);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(counters.size()));
+}
+BENCHMARK(format_uint64)->Arg(3)->Arg(8)->Arg(20);
+
+static void format_hex_snprintf(benchmark::State& state)
+{
+    auto ids = make_counters(20);
+    char buf[32];
+    for (auto _ : state) {
+        for (auto id : ids) {
+            benchmark::DoNotOptimize(std::snprintf(
+                buf, sizeof(buf), "%llx", static_cast<unsigned long long>(id)));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(ids.size()));
+}
+BENCHMARK(format_hex_snprintf);
+
+static void format_hex(benchmark::State& state)
+{
+    auto ids = make_counters(20);
+    char buf[ekutil::max_chars<uint64_t>(16)];
+    for (auto _ : state) {
+        for (auto id : ids) {
+            benchmark::DoNotOptimize(
+                ekutil::to_chars(buf, buf + sizeof(buf), id, 16).ptr);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(ids.size()));
+}
+BENCHMARK(format_hex);
+
+// A metrics export: "<counter> <counter>\n" lines
+static void format_metrics_append(benchmark::State& state)
+{
+    auto counters = make_counters(8);
+    ekutil::small_vector<char, 256> out;
+    for (auto _ : state) {
+        out.clear();
+        for (size_t i = 0; i + 1 < counters.size(); i += 2) {
+            ekutil::append_chars(out, counters[i]);
+            out.push_back(' ');
+            ekutil::append_chars(out, static_cast<int64_t>(counters[i + 1]));
+            out.push_back('\n');
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(counters.size()));
+}
+BENCHMARK(format_metrics_append);
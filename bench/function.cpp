@@ -0,0 +1,56 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/function.h>
+
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// An event loop queueing callbacks capturing four words of state (too much
+// for the small buffer of common std::function implementations), then
+// running them
+template <typename Function>
+static void callback_queue(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<Function> queue;
+    queue.reserve(n);
+    std::vector<size_t> results(n);
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i) {
+            auto out = &results[i];
+            auto a = i;
+            auto b = i * 2;
+            auto c = i * 3;
+            queue.emplace_back([out, a, b, c] { *out = a + b + c; });
+        }
+        for (auto& f : queue) {
+            f();
+        }
+        queue.clear();
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(callback_queue, std::function<void()>)->Arg(1024);
+BENCHMARK_TEMPLATE(callback_queue, ekutil::inplace_function<void()>)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(callback_queue, ekutil::small_function<void()>)
+    ->Arg(1024);
@@ -0,0 +1,80 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+#include <ekutil/hash.h>
+#include <ekutil/string_view.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Keys from a few bytes (identifiers) to page-sized blobs
+static void hash_std_string(benchmark::State& state)
+{
+    std::string key(static_cast<size_t>(state.range(0)), 'x');
+    std::hash<std::string> h;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(key);
+        benchmark::DoNotOptimize(h(key));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(hash_std_string)->RangeMultiplier(4)->Range(4, 64 << 10);
+
+static void hash_string_view(benchmark::State& state)
+{
+    std::string key(static_cast<size_t>(state.range(0)), 'x');
+    ekutil::string_view v(key.data(), key.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(ekutil::hash(v));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(hash_string_view)->RangeMultiplier(4)->Range(4, 64 << 10);
+
+static void hash_span_uint64(benchmark::State& state)
+{
+    std::vector<uint64_t> values(static_cast<size_t>(state.range(0)), 7);
+    ekutil::span<const uint64_t> s(values.data(), values.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(s);
+        benchmark::DoNotOptimize(ekutil::hash(s));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 8);
+}
+BENCHMARK(hash_span_uint64)->Range(1, 8 << 10);
+
+// 64 KiB in pieces of a given size, as read from a stream
+static void hash_streaming(benchmark::State& state)
+{
+    std::string data(64 << 10, 'x');
+    auto piece = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        ekutil::hasher h;
+        for (size_t i = 0; i < data.size(); i += piece) {
+            h.update(data.data() + i, std::min(piece, data.size() - i));
+        }
+        benchmark::DoNotOptimize(h.digest());
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(data.size()));
+}
+BENCHMARK(hash_streaming)->Arg(16)->Arg(100)->Arg(4 << 10);
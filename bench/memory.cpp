@@ -0,0 +1,217 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/memory.h>
+#include <ekutil/ring_buffer.h>
+#include <ekutil/small_vector.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// A request handler building short-lived node-based containers:
+// one free per node, or one arena reset per request
+static void request_list_std_allocator(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        std::list<int> l;
+        for (int i = 0; i < n; ++i) {
+            l.push_back(i);
+        }
+        benchmark::DoNotOptimize(l.back());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(request_list_std_allocator)->Range(64, 16 << 10);
+
+static void request_list_arena(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    ekutil::inline_monotonic_arena<4096> arena;
+    for (auto _ : state) {
+        {
+            std::list<int, ekutil::arena_allocator<int>> l(arena);
+            for (int i = 0; i < n; ++i) {
+                l.push_back(i);
+            }
+            benchmark::DoNotOptimize(l.back());
+        }
+        arena.release();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(request_list_arena)->Range(64, 16 << 10);
+
+static void request_small_vector_arena(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    ekutil::inline_monotonic_arena<4096> arena;
+    for (auto _ : state) {
+        {
+            ekutil::small_vector<int, 16, ekutil::arena_allocator<int>> v(
+                arena);
+            for (int i = 0; i < n; ++i) {
+                v.push_back(i);
+            }
+            benchmark::DoNotOptimize(v.data());
+        }
+        arena.release();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(request_small_vector_arena)->Range(64, 16 << 10);
+
+struct connection {
+    explicit connection(int i) : id(i) {}
+
+    int id;
+    char buffer[120]{};
+};
+
+// Churn through same-sized objects, keeping a window of them alive
+static void churn_new_delete(benchmark::State& state)
+{
+    std::vector<std::unique_ptr<connection>> live(64);
+    int i = 0;
+    for (auto _ : state) {
+        live[static_cast<size_t>(i) % live.size()].reset(new connection(i));
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(churn_new_delete)->ThreadRange(1, 4);
+
+static void churn_object_pool(benchmark::State& state)
+{
+    static ekutil::object_pool<connection> pool;
+    std::vector<ekutil::object_pool<connection>::unique_ptr_type> live(64);
+    int i = 0;
+    for (auto _ : state) {
+        live[static_cast<size_t>(i) % live.size()] = pool.make_unique(i);
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(churn_object_pool)->ThreadRange(1, 4);
+
+// Messages of 16 to 1024 bytes, allocated by a producer thread and freed
+// by the benchmark thread after going through a queue
+struct message_new_delete {
+    static void* allocate(size_t n)
+    {
+        return ::operator new(n);
+    }
+    static void deallocate(void* p, size_t)
+    {
+        ::operator delete(p);
+    }
+};
+struct message_slab_pool {
+    static void* allocate(size_t n)
+    {
+        return ekutil::default_slab_pool().allocate(n);
+    }
+    static void deallocate(void* p, size_t n)
+    {
+        ekutil::default_slab_pool().deallocate(p, n);
+    }
+};
+
+template <typename Heap>
+static void producer_consumer_free(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    ekutil::spsc_queue<void*> queue(1024);
+    auto message_size = [](size_t i) { return size_t{16} << (i % 7); };
+    for (auto _ : state) {
+        std::thread producer([&] {
+            for (size_t i = 0; i < n; ++i) {
+                auto p = Heap::allocate(message_size(i));
+                while (!queue.try_push(p)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        for (size_t i = 0; i < n; ++i) {
+            void* p;
+            while (!queue.try_pop(p)) {
+                std::this_thread::yield();
+            }
+            Heap::deallocate(p, message_size(i));
+        }
+        producer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(producer_consumer_free, message_new_delete)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(producer_consumer_free, message_slab_pool)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+
+static void uninitialized_fill_zero(benchmark::State& state)
+{
+    std::vector<int> buf(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        ekutil::uninitialized_fill(buf.data(), buf.data() + buf.size(), 0);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) *
+                            static_cast<int64_t>(sizeof(int)));
+}
+BENCHMARK(uninitialized_fill_zero)->Range(64, 64 << 10);
+
+static void uninitialized_copy_int(benchmark::State& state)
+{
+    std::vector<int> src(static_cast<size_t>(state.range(0)), 1);
+    std::vector<int> dst(src.size());
+    for (auto _ : state) {
+        ekutil::uninitialized_copy(src.data(), src.data() + src.size(),
+                                   dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) *
+                            static_cast<int64_t>(sizeof(int)));
+}
+BENCHMARK(uninitialized_copy_int)->Range(64, 64 << 10);
+
+// Statistics counters bumped from every thread
+static std::atomic<uint64_t> shared_counter{0};
+static void counter_shared_atomic(benchmark::State& state)
+{
+    for (auto _ : state) {
+        shared_counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(counter_shared_atomic)->ThreadRange(1, 16)->UseRealTime();
+
+static ekutil::distributed_counter sharded_counter;
+static void counter_distributed(benchmark::State& state)
+{
+    for (auto _ : state) {
+        sharded_counter.add();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(counter_distributed)->ThreadRange(1, 16)->UseRealTime();
@@ -0,0 +1,43 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/numeric.h>
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+template <typename T>
+static void next_pow2(benchmark::State& state)
+{
+    // Fixed seed: the same inputs on every run
+    std::mt19937_64 rng(42);
+    std::vector<T> input(1024);
+    for (auto& e : input) {
+        e = static_cast<T>(rng() >> (sizeof(uint64_t) * 8 - sizeof(T) * 8 + 1));
+    }
+    for (auto _ : state) {
+        for (auto e : input) {
+            benchmark::DoNotOptimize(ekutil::next_pow2(e));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(input.size()));
+}
+BENCHMARK_TEMPLATE(next_pow2, uint32_t);
+BENCHMARK_TEMPLATE(next_pow2, uint64_t);
@@ -0,0 +1,136 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/ring_buffer.h>
+
+#include <benchmark/benchmark.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Baseline: a bounded std::deque behind a mutex
+template <typename T>
+class mutex_queue {
+public:
+    explicit mutex_queue(size_t capacity) : m_capacity(capacity) {}
+
+    bool try_push(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.size() == m_capacity) {
+            return false;
+        }
+        m_queue.push_back(value);
+        return true;
+    }
+    bool try_pop(T& out)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.empty()) {
+            return false;
+        }
+        out = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<T> m_queue;
+    size_t m_capacity;
+};
+
+// One producer thread handing off `n` integers to the benchmark thread
+template <typename Queue>
+static void producer_consumer(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    Queue queue(1024);
+    for (auto _ : state) {
+        std::thread producer([&] {
+            for (size_t i = 0; i < n; ++i) {
+                while (!queue.try_push(i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        size_t sum = 0, value = 0;
+        for (size_t i = 0; i < n; ++i) {
+            while (!queue.try_pop(value)) {
+                std::this_thread::yield();
+            }
+            sum += value;
+        }
+        producer.join();
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(producer_consumer, mutex_queue<size_t>)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(producer_consumer, ekutil::spsc_queue<size_t>)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(producer_consumer, ekutil::mpmc_queue<size_t>)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+
+// Same, but moving elements in batches of 64 with try_push_n/try_pop_n
+template <typename Queue>
+static void producer_consumer_batch(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    Queue queue(1024);
+    for (auto _ : state) {
+        std::thread producer([&] {
+            size_t batch[64];
+            for (size_t i = 0; i < n;) {
+                for (size_t j = 0; j < 64; ++j) {
+                    batch[j] = i + j;
+                }
+                auto pushed =
+                    queue.try_push_n(ekutil::span<const size_t>(batch, 64));
+                if (pushed == 0) {
+                    std::this_thread::yield();
+                }
+                i += pushed;
+            }
+        });
+        size_t sum = 0, batch[64];
+        for (size_t i = 0; i < n;) {
+            auto popped = queue.try_pop_n(ekutil::span<size_t>(batch, 64));
+            if (popped == 0) {
+                std::this_thread::yield();
+            }
+            for (size_t j = 0; j < popped; ++j) {
+                sum += batch[j];
+            }
+            i += popped;
+        }
+        producer.join();
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(producer_consumer_batch, ekutil::spsc_queue<size_t>)
+    ->Arg(1 << 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(producer_consumer_batch, ekutil::mpmc_queue<size_t>)
+    ->Arg(1 << 16)
+    ->UseRealTime();
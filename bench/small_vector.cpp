@@ -0,0 +1,355 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/small_vector.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    // Owning handle with a user-provided move constructor:
+    // relocated one element at a time
+    struct handle {
+        handle(int v) : value(v) {}
+        handle(const handle& o) : value(o.value) {}
+        handle(handle&& o) noexcept : value(o.value)
+        {
+            o.value = -1;
+        }
+        handle& operator=(handle) = delete;
+        ~handle()
+        {
+            benchmark::DoNotOptimize(value);
+        }
+
+        int value;
+    };
+
+    // Same as `handle`, but opted in to relocation by `memcpy`
+    struct relocatable_handle : handle {
+        using handle::handle;
+    };
+}  // namespace
+
+namespace ekutil {
+    template <>
+    struct is_trivially_relocatable<relocatable_handle> : std::true_type {
+    };
+}  // namespace ekutil
+
+namespace {
+    template <typename T>
+    T make_value(int i);
+    template <>
+    int make_value<int>(int i)
+    {
+        return i;
+    }
+    template <>
+    std::string make_value<std::string>(int i)
+    {
+        // Long enough to not fit in the small string buffer
+        return std::string(32, static_cast<char>('a' + i % 26));
+    }
+
+    int element_weight(int e)
+    {
+        return e;
+    }
+    int element_weight(const std::string& e)
+    {
+        return static_cast<int>(e.size());
+    }
+
+    template <typename Vector>
+    Vector make_vector(int n)
+    {
+        Vector v;
+        for (int i = 0; i != n; ++i) {
+            v.push_back(make_value<typename Vector::value_type>(i));
+        }
+        return v;
+    }
+
+    // Straddle the inline capacities below, to show the cost of spilling
+    void vector_sizes(benchmark::internal::Benchmark* b)
+    {
+        for (auto n : {1, 4, 5, 16, 17, 64, 1024}) {
+            b->Arg(n);
+        }
+    }
+}  // namespace
+
+using int_small_vector_4 = ekutil::small_vector<int, 4>;
+using int_small_vector_16 = ekutil::small_vector<int, 16>;
+using int_std_vector = std::vector<int>;
+using string_small_vector_4 = ekutil::small_vector<std::string, 4>;
+using string_small_vector_16 = ekutil::small_vector<std::string, 16>;
+using string_std_vector = std::vector<std::string>;
+
+#define EKUTIL_BENCH_VECTORS(fn)                                         \
+    BENCHMARK_TEMPLATE(fn, int_small_vector_4)->Apply(vector_sizes);     \
+    BENCHMARK_TEMPLATE(fn, int_small_vector_16)->Apply(vector_sizes);    \
+    BENCHMARK_TEMPLATE(fn, int_std_vector)->Apply(vector_sizes);         \
+    BENCHMARK_TEMPLATE(fn, string_small_vector_4)->Apply(vector_sizes);  \
+    BENCHMARK_TEMPLATE(fn, string_small_vector_16)->Apply(vector_sizes); \
+    BENCHMARK_TEMPLATE(fn, string_std_vector)->Apply(vector_sizes)
+
+template <typename Vector>
+static void vector_push_back(benchmark::State& state)
+{
+    using value_type = typename Vector::value_type;
+    auto n = static_cast<int>(state.range(0));
+    std::vector<value_type> src;
+    for (int i = 0; i != n; ++i) {
+        src.push_back(make_value<value_type>(i));
+    }
+    for (auto _ : state) {
+        Vector v;
+        for (const auto& e : src) {
+            v.push_back(e);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+EKUTIL_BENCH_VECTORS(vector_push_back);
+
+template <typename Vector>
+static void vector_copy(benchmark::State& state)
+{
+    auto src = make_vector<Vector>(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        Vector v(src);
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+EKUTIL_BENCH_VECTORS(vector_copy);
+
+// One move construction and one move assignment per iteration
+template <typename Vector>
+static void vector_move(benchmark::State& state)
+{
+    auto a = make_vector<Vector>(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        Vector b(std::move(a));
+        benchmark::DoNotOptimize(b.data());
+        a = std::move(b);
+        benchmark::DoNotOptimize(a.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+EKUTIL_BENCH_VECTORS(vector_move);
+
+template <typename Vector>
+static void vector_iterate(benchmark::State& state)
+{
+    auto v = make_vector<Vector>(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        int sum = 0;
+        for (const auto& e : v) {
+            sum += element_weight(e);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+EKUTIL_BENCH_VECTORS(vector_iterate);
+
+template <typename T>
+static void small_vector_growth(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        ekutil::small_vector<T, 8> v;
+        for (int i = 0; i != n; ++i) {
+            v.emplace_back(i);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_TEMPLATE(small_vector_growth, int)->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(small_vector_growth, handle)->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(small_vector_growth, relocatable_handle)
+    ->Range(64, 64 << 10);
+
+// Sum the elements of many short vectors: measures the cost of
+// begin()/end()/size(), not the summing
+template <size_t StackN>
+static void small_vector_iteration(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    std::vector<ekutil::small_vector<int, StackN>> vectors(1024);
+    for (auto& v : vectors) {
+        for (int i = 0; i != n; ++i) {
+            v.push_back(i);
+        }
+    }
+    for (auto _ : state) {
+        long sum = 0;
+        for (const auto& v : vectors) {
+            for (auto e : v) {
+                sum += e;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(vectors.size()));
+}
+// Inline
+BENCHMARK_TEMPLATE(small_vector_iteration, 8)->Arg(1)->Arg(4)->Arg(8);
+// Spilled to the heap
+BENCHMARK_TEMPLATE(small_vector_iteration, 0)->Arg(1)->Arg(4)->Arg(8);
+
+// Build a vector from a range: element by element, and in one call
+static void small_vector_ingest_push_back(benchmark::State& state)
+{
+    std::vector<int> src(static_cast<size_t>(state.range(0)), 42);
+    for (auto _ : state) {
+        ekutil::small_vector<int, 8> v;
+        for (auto e : src) {
+            v.push_back(e);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(small_vector_ingest_push_back)->Range(64, 64 << 10);
+
+static void small_vector_ingest_append(benchmark::State& state)
+{
+    std::vector<int> src(static_cast<size_t>(state.range(0)), 42);
+    for (auto _ : state) {
+        ekutil::small_vector<int, 8> v;
+        v.append(src.begin(), src.end());
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(small_vector_ingest_append)->Range(64, 64 << 10);
+
+template <typename GrowthPolicy,
+          typename Allocator = std::allocator<double>>
+static void small_vector_growth_policy(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    using vector_type =
+        ekutil::small_vector<double, 8, Allocator, GrowthPolicy>;
+    size_t capacity = 0;
+    for (auto _ : state) {
+        vector_type v;
+        for (int i = 0; i != n; ++i) {
+            v.push_back(i);
+        }
+        benchmark::DoNotOptimize(v.data());
+        capacity = v.capacity();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["capacity"] = static_cast<double>(capacity);
+}
+BENCHMARK_TEMPLATE(small_vector_growth_policy, ekutil::pow2_growth)
+    ->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(small_vector_growth_policy, ekutil::factor_1_5_growth)
+    ->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(small_vector_growth_policy,
+                   ekutil::factor_1_5_growth,
+                   ekutil::slab_allocator<double>)
+    ->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(small_vector_growth_policy,
+                   ekutil::size_class_growth,
+                   ekutil::slab_allocator<double>)
+    ->Range(64, 64 << 10);
+
+// Grow a byte buffer, to be overwritten by e.g. read()
+static void small_vector_resize_bytes(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    ekutil::small_vector<char, 64> buf;
+    for (auto _ : state) {
+        buf.clear();
+        buf.resize(n);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(small_vector_resize_bytes)->Range(4 << 10, 1 << 20);
+
+static void small_vector_resize_for_overwrite_bytes(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    ekutil::small_vector<char, 64> buf;
+    for (auto _ : state) {
+        buf.clear();
+        buf.resize_for_overwrite(n);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(small_vector_resize_for_overwrite_bytes)->Range(4 << 10, 1 << 20);
+
+// Swap two vectors of the same size: inline/inline up to 8, heap/heap above
+template <typename T>
+static void small_vector_swap(benchmark::State& state)
+{
+    auto n = static_cast<int>(state.range(0));
+    ekutil::small_vector<T, 8> a, b;
+    for (int i = 0; i < n; ++i) {
+        a.push_back(make_value<T>(i));
+        b.push_back(make_value<T>(i + n));
+    }
+    for (auto _ : state) {
+        a.swap(b);
+        benchmark::DoNotOptimize(a.data());
+        benchmark::DoNotOptimize(b.data());
+    }
+}
+BENCHMARK_TEMPLATE(small_vector_swap, int)->Arg(4)->Arg(8)->Arg(64);
+BENCHMARK_TEMPLATE(small_vector_swap, std::string)->Arg(4)->Arg(8)->Arg(64);
+
+// Grow a vector to hundreds of megabytes: every reallocation copies
+// everything with the default allocator, and moves pages with
+// large_buffer_allocator
+template <typename Allocator>
+static void small_vector_large_growth(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        ekutil::small_vector<uint64_t, 8, Allocator> v;
+        for (size_t i = 0; i < n; ++i) {
+            v.push_back(i);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) *
+                            static_cast<int64_t>(sizeof(uint64_t)));
+}
+BENCHMARK_TEMPLATE(small_vector_large_growth, std::allocator<uint64_t>)
+    ->Arg(1 << 22)
+    ->Arg(1 << 25)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(small_vector_large_growth,
+                   ekutil::large_buffer_allocator<uint64_t>)
+    ->Arg(1 << 22)
+    ->Arg(1 << 25)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,67 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/span.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+static void span_iterate(benchmark::State& state)
+{
+    std::vector<int> data(static_cast<size_t>(state.range(0)), 1);
+    auto s = ekutil::make_span(data);
+    for (auto _ : state) {
+        int sum = 0;
+        for (auto e : s) {
+            sum += e;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(span_iterate)->Range(8, 64 << 10);
+
+static void span_index(benchmark::State& state)
+{
+    std::vector<int> data(static_cast<size_t>(state.range(0)), 1);
+    auto s = ekutil::make_span(data);
+    for (auto _ : state) {
+        int sum = 0;
+        for (std::ptrdiff_t i = 0; i != s.size(); ++i) {
+            sum += s[i];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(span_index)->Range(8, 64 << 10);
+
+// Baseline for the two above
+static void raw_pointer_iterate(benchmark::State& state)
+{
+    std::vector<int> data(static_cast<size_t>(state.range(0)), 1);
+    for (auto _ : state) {
+        int sum = 0;
+        for (auto p = data.data(), end = p + data.size(); p != end; ++p) {
+            sum += *p;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(raw_pointer_iterate)->Range(8, 64 << 10);
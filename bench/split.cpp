@@ -0,0 +1,145 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+#include <ekutil/split.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+// 1 MiB of records like "1234,worker-17,\"said \"\"hi\"\"\",0.5", one in
+// eight quoted and one in 32 with escaped quotes
+static std::string make_csv()
+{
+    std::string csv;
+    for (size_t i = 0; csv.size() < (1 << 20); ++i) {
+        csv += std::to_string(i * 7919 % 100000);
+        csv += ",worker-";
+        csv += std::to_string(i % 64);
+        csv += ',';
+        if (i % 32 == 0) {
+            csv += "\"said \"\"hi\"\", then left\"";
+        }
+        else if (i % 8 == 0) {
+            csv += "\"started, then stopped\"";
+        }
+        else {
+            csv += "running normally for now";
+        }
+        csv += ",0.";
+        csv += std::to_string(i % 1000);
+        csv += '\n';
+    }
+    return csv;
+}
+
+// What the tokenizer replaces: every field copied into a std::string
+static void csv_copy_fields(benchmark::State& state)
+{
+    auto csv = make_csv();
+    std::string field;
+    for (auto _ : state) {
+        size_t fields = 0;
+        bool quoted = false;
+        for (size_t i = 0; i < csv.size(); ++i) {
+            auto c = csv[i];
+            if (quoted) {
+                if (c != '"') {
+                    field += c;
+                }
+                else if (i + 1 < csv.size() && csv[i + 1] == '"') {
+                    field += c;
+                    ++i;
+                }
+                else {
+                    quoted = false;
+                }
+            }
+            else if (c == '"') {
+                quoted = true;
+            }
+            else if (c == ',' || c == '\n') {
+                benchmark::DoNotOptimize(field.data());
+                field.clear();
+                ++fields;
+            }
+            else {
+                field += c;
+            }
+        }
+        benchmark::DoNotOptimize(fields);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(csv.size()));
+}
+BENCHMARK(csv_copy_fields);
+
+static void csv_tokenizer_fields(benchmark::State& state)
+{
+    auto csv = make_csv();
+    std::string buffer;
+    for (auto _ : state) {
+        ekutil::csv_tokenizer tokens(
+            ekutil::string_view(csv.data(), csv.size()));
+        ekutil::csv_field field;
+        size_t fields = 0;
+        while (tokens.next(field)) {
+            benchmark::DoNotOptimize(field.value(buffer).data());
+            ++fields;
+        }
+        benchmark::DoNotOptimize(fields);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(csv.size()));
+}
+BENCHMARK(csv_tokenizer_fields);
+
+static void split_lines(benchmark::State& state)
+{
+    auto csv = make_csv();
+    for (auto _ : state) {
+        size_t lines = 0;
+        for (auto line :
+             ekutil::split(ekutil::string_view(csv.data(), csv.size()),
+                           '\n')) {
+            benchmark::DoNotOptimize(line);
+            ++lines;
+        }
+        benchmark::DoNotOptimize(lines);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(csv.size()));
+}
+BENCHMARK(split_lines);
+
+static void split_words(benchmark::State& state)
+{
+    auto csv = make_csv();
+    auto delims = ekutil::any_of(" ,\n");
+    for (auto _ : state) {
+        size_t words = 0;
+        for (auto word : ekutil::split(
+                 ekutil::string_view(csv.data(), csv.size()), delims)) {
+            benchmark::DoNotOptimize(word);
+            ++words;
+        }
+        benchmark::DoNotOptimize(words);
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(csv.size()));
+}
+BENCHMARK(split_words);
@@ -0,0 +1,155 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/string_view.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+static void string_view_compare_equal(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    std::string a(n, 'x'), b(n, 'x');
+    ekutil::string_view va(a.data(), a.size()), vb(b.data(), b.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(va);
+        benchmark::DoNotOptimize(vb);
+        benchmark::DoNotOptimize(va.compare(vb));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_compare_equal)->Range(8, 4 << 10);
+
+// Differ in the first character: the cost of a call, not of the scan
+static void string_view_compare_mismatch(benchmark::State& state)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    std::string a(n, 'x'), b(n, 'y');
+    ekutil::string_view va(a.data(), a.size()), vb(b.data(), b.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(va);
+        benchmark::DoNotOptimize(vb);
+        benchmark::DoNotOptimize(va.compare(vb));
+    }
+}
+BENCHMARK(string_view_compare_mismatch)->Range(8, 4 << 10);
+
+// Slice a line into fixed-width fields
+static void string_view_substr(benchmark::State& state)
+{
+    auto width = static_cast<size_t>(state.range(0));
+    std::string line(4096, 'x');
+    ekutil::string_view v(line.data(), line.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < v.size(); i += width) {
+            auto field = v.substr(i, width);
+            benchmark::DoNotOptimize(field);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(line.size() / width));
+}
+BENCHMARK(string_view_substr)->Arg(4)->Arg(16)->Arg(64);
+
+// Search a log line, the match at the very end: a hand-rolled loop, as
+// callers used to write, std::string, and string_view
+static std::string log_line(size_t n)
+{
+    std::string line;
+    while (line.size() < n) {
+        line += "2019-06-01T12:00:00 INFO worker-7 request ok ";
+    }
+    line.resize(n);
+    line.back() = '|';
+    return line;
+}
+
+static void string_view_find_char_loop(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(line);
+        size_t i = 0;
+        while (i != line.size() && line[i] != '|') {
+            ++i;
+        }
+        benchmark::DoNotOptimize(i);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_char_loop)->Range(64, 4 << 10);
+
+static void string_view_find_char(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    ekutil::string_view v(line.data(), line.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(v.find('|'));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_char)->Range(64, 4 << 10);
+
+static void string_view_find_first_of_std(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(line);
+        benchmark::DoNotOptimize(line.find_first_of("|;\"\t"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_first_of_std)->Range(64, 4 << 10);
+
+static void string_view_find_first_of(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    ekutil::string_view v(line.data(), line.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(v.find_first_of("|;\"\t"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_first_of)->Range(64, 4 << 10);
+
+static void string_view_find_substring_std(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    line.replace(line.size() - 9, 9, "worker-9|");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(line);
+        benchmark::DoNotOptimize(line.find("worker-9"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_substring_std)->Range(64, 4 << 10);
+
+static void string_view_find_substring(benchmark::State& state)
+{
+    auto line = log_line(static_cast<size_t>(state.range(0)));
+    line.replace(line.size() - 9, 9, "worker-9|");
+    ekutil::string_view v(line.data(), line.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(v.find("worker-9"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(string_view_find_substring)->Range(64, 4 << 10);
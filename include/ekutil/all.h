@@ -20,11 +20,17 @@
 
 #include "compat.h"
 
+#include "char_search.h"
+#include "charconv.h"
+#include "function.h"
+#include "hash.h"
 #include "memory.h"
 #include "meta.h"
 #include "numeric.h"
+#include "ring_buffer.h"
 #include "small_vector.h"
 #include "span.h"
+#include "split.h"
 #include "string_view.h"
 
 #endif  // EKUTIL_ALL_H
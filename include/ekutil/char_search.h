@@ -0,0 +1,423 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_CHAR_SEARCH_H
+#define EKUTIL_CHAR_SEARCH_H
+
+#include "numeric.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if EKUTIL_HAS_AVX2
+#include <immintrin.h>
+#elif EKUTIL_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace ekutil {
+    /// Returned by the search functions when nothing is found
+    EKUTIL_CONSTEXPR_DECL const size_t char_search_npos = size_t(-1);
+
+#if EKUTIL_HAS_SSE2
+    /**
+     * The widest vector of chars available: 32 with AVX2, 16 with SSE2.
+     * Comparisons give a mask with a bit per char, the first char in the
+     * lowest bit.
+     */
+    struct char_block {
+#if EKUTIL_HAS_AVX2
+        static EKUTIL_CONSTEXPR_DECL const size_t width = 32;
+        static EKUTIL_CONSTEXPR_DECL const uint32_t all = 0xffffffff;
+
+        static char_block load(const char* p) noexcept
+        {
+            return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))};
+        }
+        static char_block splat(char c) noexcept
+        {
+            return {_mm256_set1_epi8(c)};
+        }
+        uint32_t eq(char_block other) const noexcept
+        {
+            return static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(value, other.value)));
+        }
+        /// Mask of the chars in `[lo, hi]`, compared as unsigned
+        uint32_t in_range(char lo, char hi) const noexcept
+        {
+            auto d = _mm256_sub_epi8(value, _mm256_set1_epi8(lo));
+            auto w = _mm256_set1_epi8(static_cast<char>(hi - lo));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_min_epu8(d, w), d)));
+        }
+
+        __m256i value;
+#else
+        static EKUTIL_CONSTEXPR_DECL const size_t width = 16;
+        static EKUTIL_CONSTEXPR_DECL const uint32_t all = 0xffff;
+
+        static char_block load(const char* p) noexcept
+        {
+            return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))};
+        }
+        static char_block splat(char c) noexcept
+        {
+            return {_mm_set1_epi8(c)};
+        }
+        uint32_t eq(char_block other) const noexcept
+        {
+            return static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(value, other.value)));
+        }
+        /// Mask of the chars in `[lo, hi]`, compared as unsigned
+        uint32_t in_range(char lo, char hi) const noexcept
+        {
+            auto d = _mm_sub_epi8(value, _mm_set1_epi8(lo));
+            auto w = _mm_set1_epi8(static_cast<char>(hi - lo));
+            return static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, w), d)));
+        }
+
+        __m128i value;
+#endif
+    };
+#endif
+
+    /**
+     * A set of chars to search for.
+     * Sets of up to `max_vector_size` distinct chars are searched for
+     * a block at a time (one comparison per char), larger ones a char at a
+     * time (with a lookup table).
+     */
+    class char_set {
+    public:
+        static EKUTIL_CONSTEXPR_DECL const size_t max_vector_size = 16;
+
+        char_set(const char* s, size_t n) noexcept
+        {
+            for (size_t i = 0; i < n; ++i) {
+                auto c = static_cast<unsigned char>(s[i]);
+                auto bit = uint64_t{1} << (c % 64);
+                if ((m_bits[c / 64] & bit) != 0) {
+                    continue;
+                }
+                m_bits[c / 64] |= bit;
+#if EKUTIL_HAS_SSE2
+                if (m_count < max_vector_size) {
+                    m_chars[m_count] = char_block::splat(s[i]);
+                }
+#endif
+                ++m_count;
+            }
+        }
+
+        bool test(char ch) const noexcept
+        {
+            auto c = static_cast<unsigned char>(ch);
+            return ((m_bits[c / 64] >> (c % 64)) & 1) != 0;
+        }
+        /// Number of distinct chars
+        size_t size() const noexcept
+        {
+            return m_count;
+        }
+
+#if EKUTIL_HAS_SSE2
+        bool vectorized() const noexcept
+        {
+            return m_count <= max_vector_size;
+        }
+        uint32_t mask(char_block b) const noexcept
+        {
+            uint32_t m = 0;
+            for (size_t i = 0; i < m_count; ++i) {
+                m |= b.eq(m_chars[i]);
+            }
+            return m;
+        }
+#endif
+
+    private:
+        uint64_t m_bits[4]{};
+        size_t m_count{0};
+#if EKUTIL_HAS_SSE2
+        char_block m_chars[max_vector_size];
+#endif
+    };
+
+    /// Matches one char, like `char_set`
+    struct _char_eq {
+        explicit _char_eq(char ch) noexcept : c(ch)
+        {
+#if EKUTIL_HAS_SSE2
+            block = char_block::splat(ch);
+#endif
+        }
+
+        bool test(char x) const noexcept
+        {
+            return x == c;
+        }
+#if EKUTIL_HAS_SSE2
+        bool vectorized() const noexcept
+        {
+            return true;
+        }
+        uint32_t mask(char_block b) const noexcept
+        {
+            return b.eq(block);
+        }
+#endif
+
+        char c;
+#if EKUTIL_HAS_SSE2
+        char_block block;
+#endif
+    };
+
+    /// Matches the chars `Matcher` doesn't
+    template <typename Matcher>
+    struct _char_not {
+        bool test(char x) const noexcept
+        {
+            return !m.test(x);
+        }
+#if EKUTIL_HAS_SSE2
+        bool vectorized() const noexcept
+        {
+            return m.vectorized();
+        }
+        uint32_t mask(char_block b) const noexcept
+        {
+            return ~m.mask(b) & char_block::all;
+        }
+#endif
+
+        const Matcher& m;
+    };
+
+    /// Index of the first char of `[s, s + n)` matched by `m`
+    template <typename Matcher>
+    size_t _find_if(const char* s, size_t n, const Matcher& m) noexcept
+    {
+#if EKUTIL_HAS_SSE2
+        EKUTIL_CONSTEXPR_DECL const size_t w = char_block::width;
+        if (n >= w && m.vectorized()) {
+            size_t i = 0;
+            for (; i + w <= n; i += w) {
+                auto mask = m.mask(char_block::load(s + i));
+                if (mask != 0) {
+                    return i + static_cast<size_t>(countr_zero(mask));
+                }
+            }
+            if (i == n) {
+                return char_search_npos;
+            }
+            // Last, overlapping block: skip the chars already seen
+            auto mask = m.mask(char_block::load(s + n - w)) >> (w - (n - i));
+            return mask != 0 ? i + static_cast<size_t>(countr_zero(mask))
+                             : char_search_npos;
+        }
+#endif
+        for (size_t i = 0; i < n; ++i) {
+            if (m.test(s[i])) {
+                return i;
+            }
+        }
+        return char_search_npos;
+    }
+
+    /// Index of the last char of `[s, s + n)` matched by `m`
+    template <typename Matcher>
+    size_t _rfind_if(const char* s, size_t n, const Matcher& m) noexcept
+    {
+        auto i = n;
+#if EKUTIL_HAS_SSE2
+        EKUTIL_CONSTEXPR_DECL const size_t w = char_block::width;
+        if (n >= w && m.vectorized()) {
+            for (; i >= w; i -= w) {
+                auto mask = m.mask(char_block::load(s + i - w));
+                if (mask != 0) {
+                    return i - w + static_cast<size_t>(31 - countl_zero(mask));
+                }
+            }
+            if (i == 0) {
+                return char_search_npos;
+            }
+            // First, overlapping block: skip the chars already seen
+            auto mask =
+                m.mask(char_block::load(s)) & ((uint32_t{1} << i) - 1);
+            return mask != 0 ? static_cast<size_t>(31 - countl_zero(mask))
+                             : char_search_npos;
+        }
+#endif
+        while (i-- > 0) {
+            if (m.test(s[i])) {
+                return i;
+            }
+        }
+        return char_search_npos;
+    }
+
+    /// Index of the first `c` in `[s, s + n)`, or `char_search_npos`
+    inline size_t find_char(const char* s, size_t n, char c) noexcept
+    {
+#if EKUTIL_HAS_SSE2
+        return _find_if(s, n, _char_eq(c));
+#else
+        if (n == 0) {
+            return char_search_npos;
+        }
+        auto p = static_cast<const char*>(std::memchr(s, c, n));
+        return p ? static_cast<size_t>(p - s) : char_search_npos;
+#endif
+    }
+    /// Index of the last `c` in `[s, s + n)`, or `char_search_npos`
+    inline size_t rfind_char(const char* s, size_t n, char c) noexcept
+    {
+        return _rfind_if(s, n, _char_eq(c));
+    }
+
+    /// Index of the first char of `[s, s + n)` in `set`, or
+    /// `char_search_npos`
+    inline size_t find_char_of(const char* s,
+                               size_t n,
+                               const char_set& set) noexcept
+    {
+        return _find_if(s, n, set);
+    }
+    /// Index of the first char of `[s, s + n)` not in `set`, or
+    /// `char_search_npos`
+    inline size_t find_char_not_of(const char* s,
+                                   size_t n,
+                                   const char_set& set) noexcept
+    {
+        return _find_if(s, n, _char_not<char_set>{set});
+    }
+    /// Index of the last char of `[s, s + n)` in `set`, or
+    /// `char_search_npos`
+    inline size_t rfind_char_of(const char* s,
+                                size_t n,
+                                const char_set& set) noexcept
+    {
+        return _rfind_if(s, n, set);
+    }
+    /// Index of the last char of `[s, s + n)` not in `set`, or
+    /// `char_search_npos`
+    inline size_t rfind_char_not_of(const char* s,
+                                    size_t n,
+                                    const char_set& set) noexcept
+    {
+        return _rfind_if(s, n, _char_not<char_set>{set});
+    }
+
+    /**
+     * Index of the first occurrence of `[t, t + m)` in `[s, s + n)`, or
+     * `char_search_npos`.
+     * Candidate positions are found a block at a time, by comparing both
+     * the first and the last char of the needle, and only those are
+     * compared in full.
+     */
+    inline size_t find_substring(const char* s,
+                                 size_t n,
+                                 const char* t,
+                                 size_t m) noexcept
+    {
+        if (m == 0) {
+            return 0;
+        }
+        if (m > n) {
+            return char_search_npos;
+        }
+        if (m == 1) {
+            return find_char(s, n, t[0]);
+        }
+
+        size_t i = 0;
+#if EKUTIL_HAS_SSE2
+        EKUTIL_CONSTEXPR_DECL const size_t w = char_block::width;
+        auto first = char_block::splat(t[0]);
+        auto last = char_block::splat(t[m - 1]);
+        for (; i + m - 1 + w <= n; i += w) {
+            auto mask = char_block::load(s + i).eq(first) &
+                        char_block::load(s + i + m - 1).eq(last);
+            for (; mask != 0; mask &= mask - 1) {
+                auto j = i + static_cast<size_t>(countr_zero(mask));
+                if (std::memcmp(s + j + 1, t + 1, m - 2) == 0) {
+                    return j;
+                }
+            }
+        }
+#endif
+        for (; i + m <= n; ++i) {
+            auto j = find_char(s + i, n - m + 1 - i, t[0]);
+            if (j == char_search_npos) {
+                break;
+            }
+            i += j;
+            if (std::memcmp(s + i + 1, t + 1, m - 1) == 0) {
+                return i;
+            }
+        }
+        return char_search_npos;
+    }
+
+    /// Index of the last occurrence of `[t, t + m)` in `[s, s + n)`, or
+    /// `char_search_npos`
+    inline size_t rfind_substring(const char* s,
+                                  size_t n,
+                                  const char* t,
+                                  size_t m) noexcept
+    {
+        if (m > n) {
+            return char_search_npos;
+        }
+        if (m == 0) {
+            return n;
+        }
+
+        // One past the last candidate position left
+        auto i = n - m + 1;
+#if EKUTIL_HAS_SSE2
+        EKUTIL_CONSTEXPR_DECL const size_t w = char_block::width;
+        auto first = char_block::splat(t[0]);
+        auto last = char_block::splat(t[m - 1]);
+        for (; i >= w; i -= w) {
+            auto mask = char_block::load(s + i - w).eq(first) &
+                        char_block::load(s + i - w + m - 1).eq(last);
+            while (mask != 0) {
+                auto bit = 31 - countl_zero(mask);
+                auto j = i - w + static_cast<size_t>(bit);
+                if (std::memcmp(s + j + 1, t + 1, m - 1) == 0) {
+                    return j;
+                }
+                mask &= ~(uint32_t{1} << bit);
+            }
+        }
+#endif
+        while (i-- > 0) {
+            if (s[i] == t[0] && std::memcmp(s + i + 1, t + 1, m - 1) == 0) {
+                return i;
+            }
+        }
+        return char_search_npos;
+    }
+}  // namespace ekutil
+
+#endif  // EKUTIL_CHAR_SEARCH_H
@@ -0,0 +1,586 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_CHARCONV_H
+#define EKUTIL_CHARCONV_H
+
+#include "char_search.h"
+#include "numeric.h"
+#include "small_vector.h"
+#include "span.h"
+#include "string_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <type_traits>
+
+namespace ekutil {
+    /// Like `std::from_chars_result`
+    struct from_chars_result {
+        const char* ptr;
+        std::errc ec;
+    };
+
+    /// Value of the digit `c`, in bases up to 36, or 36 if it isn't one
+    inline unsigned _digit_value(char c) noexcept
+    {
+        auto u = static_cast<unsigned char>(c);
+        auto d = u - unsigned{'0'};
+        if (d < 10) {
+            return d;
+        }
+        auto l = (u | 0x20u) - unsigned{'a'};
+        return l < 26 ? l + 10 : 36;
+    }
+
+#if EKUTIL_LITTLE_ENDIAN
+    /// High bit of each byte of `v` that isn't an ASCII digit
+    inline uint64_t _swar_non_digits(uint64_t v) noexcept
+    {
+        auto x = v ^ 0x3030303030303030;
+        return (((x & 0x7f7f7f7f7f7f7f7f) + 0x7676767676767676) | x) &
+               0x8080808080808080;
+    }
+    /// Value of the 8 ASCII digits in `v`, the first in the lowest byte;
+    /// zero bytes count as leading zeros
+    inline uint64_t _swar_parse8(uint64_t v) noexcept
+    {
+        v = ((v & 0x0f0f0f0f0f0f0f0f) * 2561) >> 8;
+        v = ((v & 0x00ff00ff00ff00ff) * 6553601) >> 16;
+        return ((v & 0x0000ffff0000ffff) * 42949672960001) >> 32;
+    }
+#endif
+
+    /// Number of ASCII digits at the start of `[p, last)`: a block at a
+    /// time while there are enough chars left, then 8 at a time
+    inline size_t _count_digits(const char* p, const char* last) noexcept
+    {
+        auto q = p;
+#if EKUTIL_HAS_SSE2
+        while (static_cast<size_t>(last - q) >= char_block::width) {
+            auto m = char_block::load(q).in_range('0', '9');
+            if (m != char_block::all) {
+                return static_cast<size_t>(q - p) +
+                       static_cast<size_t>(countr_zero(~m));
+            }
+            q += char_block::width;
+        }
+#endif
+#if EKUTIL_LITTLE_ENDIAN
+        while (last - q >= 8) {
+            uint64_t v;
+            std::memcpy(&v, q, 8);
+            auto m = _swar_non_digits(v);
+            if (m != 0) {
+                return static_cast<size_t>(q - p) +
+                       static_cast<size_t>(countr_zero(m)) / 8;
+            }
+            q += 8;
+        }
+#endif
+        while (q != last && static_cast<unsigned char>(*q - '0') < 10) {
+            ++q;
+        }
+        return static_cast<size_t>(q - p);
+    }
+
+    /// Value of the `n` (at most 8) digits at `p`
+    inline uint64_t _parse_digits(const char* p,
+                                  size_t n,
+                                  const char* last) noexcept
+    {
+#if EKUTIL_LITTLE_ENDIAN
+        uint64_t v = 0;
+        if (last - p >= 8) {
+            std::memcpy(&v, p, 8);
+        }
+        else {
+            std::memcpy(&v, p, n);
+        }
+        // Move the digits to the top, behind zero bytes
+        return _swar_parse8(v << (8 * (8 - n)));
+#else
+        EKUTIL_UNUSED(last);
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; ++i) {
+            v = v * 10 + static_cast<unsigned char>(p[i] - '0');
+        }
+        return v;
+#endif
+    }
+
+    /// 10^k, for k < 8
+    inline uint64_t _pow10(size_t k) noexcept
+    {
+        static const uint32_t powers[] = {1,      10,      100,     1000,
+                                          10000,  100000,  1000000, 10000000};
+        return powers[k];
+    }
+
+    /// Parse the decimal number at `p` into `value`, if it's at most
+    /// `limit`
+    inline from_chars_result _parse_decimal(const char* p,
+                                            const char* last,
+                                            uint64_t limit,
+                                            uint64_t& value) noexcept
+    {
+        // Most numbers are short: up to 8 digits a char at a time, where
+        // the branches are predicted, and parsing the next number can
+        // start before this one is done
+        uint64_t acc = 0;
+        size_t n = 0;
+        for (; n != 8; ++n) {
+            if (p + n == last) {
+                break;
+            }
+            auto d = static_cast<unsigned char>(p[n] - '0');
+            if (d >= 10) {
+                break;
+            }
+            acc = acc * 10 + d;
+        }
+        if (n < 8 || p + n == last ||
+            static_cast<unsigned char>(p[n] - '0') >= 10) {
+            if (n == 0) {
+                return {p, std::errc::invalid_argument};
+            }
+            if (acc > limit) {
+                return {p + n, std::errc::result_out_of_range};
+            }
+            value = acc;
+            return {p + n, std::errc()};
+        }
+
+        // Longer ones: find where the digits end, and add them 8 at a time
+        // after any leading zeros. 19 significant digits can't overflow 64
+        // bits; only a 20th is checked.
+        auto end = p + 8 + _count_digits(p + 8, last);
+        auto first = p;
+        auto q = p + 8;
+        if (*p == '0') {
+            while (first + 1 != end && *first == '0') {
+                ++first;
+            }
+            acc = 0;
+            q = first;
+        }
+        auto digits = static_cast<size_t>(end - first);
+        if (digits > 20) {
+            return {end, std::errc::result_out_of_range};
+        }
+        auto stop = digits == 20 ? end - 1 : end;
+        while (stop - q >= 8) {
+            acc = acc * 100000000 + _parse_digits(q, 8, last);
+            q += 8;
+        }
+        if (q != stop) {
+            auto k = static_cast<size_t>(stop - q);
+            acc = acc * _pow10(k) + _parse_digits(q, k, last);
+            q = stop;
+        }
+        if (digits == 20) {
+            auto d = static_cast<unsigned char>(*q - '0');
+            if (acc > (std::numeric_limits<uint64_t>::max() - d) / 10) {
+                return {end, std::errc::result_out_of_range};
+            }
+            acc = acc * 10 + d;
+        }
+        if (acc > limit) {
+            return {end, std::errc::result_out_of_range};
+        }
+        value = acc;
+        return {end, std::errc()};
+    }
+
+    /// Parse the number in `base` at `p` into `value`, if it's at most
+    /// `limit`
+    inline from_chars_result _parse_based(const char* p,
+                                          const char* last,
+                                          int base,
+                                          uint64_t limit,
+                                          uint64_t& value) noexcept
+    {
+        auto b = static_cast<unsigned>(base);
+        auto cutoff = limit / b;
+        auto cutlim = limit % b;
+        uint64_t acc = 0;
+        bool overflow = false;
+        auto first = p;
+        for (; p != last; ++p) {
+            auto d = _digit_value(*p);
+            if (d >= b) {
+                break;
+            }
+            if (acc > cutoff || (acc == cutoff && d > cutlim)) {
+                overflow = true;
+            }
+            else {
+                acc = acc * b + d;
+            }
+        }
+        if (p == first) {
+            return {p, std::errc::invalid_argument};
+        }
+        if (overflow) {
+            return {p, std::errc::result_out_of_range};
+        }
+        value = acc;
+        return {p, std::errc()};
+    }
+
+    /// `v`, or `-v` if `negative`; `v` is at most `-min()`
+    template <typename Int>
+    Int _apply_sign(uint64_t v, bool negative, std::true_type) noexcept
+    {
+        if (!negative || v == 0) {
+            return static_cast<Int>(v);
+        }
+        return static_cast<Int>(-static_cast<Int>(v - 1) - 1);
+    }
+    template <typename Int>
+    Int _apply_sign(uint64_t v, bool, std::false_type) noexcept
+    {
+        return static_cast<Int>(v);
+    }
+
+    /**
+     * Parse an integer from `[first, last)`, like `std::from_chars`: an
+     * optional '-' (if `Int` is signed) and digits in `base` (2 to 36,
+     * letters in either case), with no whitespace, '+' or prefixes.
+     * `ptr` points past the digits, even when the value doesn't fit in
+     * `Int` (`std::errc::result_out_of_range`); `value` is only written on
+     * success.
+     * In base 10, digits past the 8th are counted a vector block at a
+     * time and parsed 8 at a time in a 64-bit word (SWAR).
+     * Unlike `std::from_chars`, available since C++11.
+     */
+    template <typename Int>
+    from_chars_result from_chars(const char* first,
+                                 const char* last,
+                                 Int& value,
+                                 int base = 10) noexcept
+    {
+        static_assert(std::is_integral<Int>::value &&
+                          !std::is_same<Int, bool>::value,
+                      "from_chars: Int must be an integer type");
+        using unsigned_type = typename std::make_unsigned<Int>::type;
+        using is_signed = std::is_signed<Int>;
+
+        auto p = first;
+        bool negative = false;
+        if (is_signed::value && p != last && *p == '-') {
+            negative = true;
+            ++p;
+        }
+        auto limit = uint64_t{static_cast<unsigned_type>(
+                         std::numeric_limits<Int>::max())} +
+                     uint64_t{negative};
+        uint64_t v = 0;
+        auto r = base == 10 ? _parse_decimal(p, last, limit, v)
+                            : _parse_based(p, last, base, limit, v);
+        if (r.ec == std::errc::invalid_argument) {
+            return {first, r.ec};
+        }
+        if (r.ec == std::errc()) {
+            value = _apply_sign<Int>(v, negative, is_signed{});
+        }
+        return r;
+    }
+    template <typename Int>
+    from_chars_result from_chars(string_view s,
+                                 Int& value,
+                                 int base = 10) noexcept
+    {
+        return from_chars(s.data(), s.data() + s.size(), value, base);
+    }
+    template <typename Int>
+    from_chars_result from_chars(span<const char> s,
+                                 Int& value,
+                                 int base = 10) noexcept
+    {
+        return from_chars(s.data(), s.data() + s.size(), value, base);
+    }
+
+    /// Result of `from_chars_column`
+    struct from_chars_column_result {
+        const char* ptr;
+        std::errc ec;
+        /// Number of values written
+        size_t count;
+    };
+
+    /**
+     * Parse a column of integers separated by `delimiter` (e.g. "1,2,3",
+     * or one per line) into `out`, in one call.
+     * Stops at the end of `s` (a trailing delimiter is allowed), when
+     * `out` is full (`ptr` is then at the next value), or at the first
+     * value that doesn't fit in `Int` or isn't followed by a delimiter
+     * (`ptr` and `ec` are then as from `from_chars`, or `ptr` at the char
+     * that should have been a delimiter).
+     */
+    template <typename Int>
+    from_chars_column_result from_chars_column(string_view s,
+                                               char delimiter,
+                                               span<Int> out,
+                                               int base = 10) noexcept
+    {
+        auto p = s.data();
+        auto last = p + s.size();
+        auto n = static_cast<size_t>(out.size());
+        size_t count = 0;
+        while (p != last && count != n) {
+            auto r = from_chars(p, last, out.data()[count], base);
+            if (r.ec != std::errc()) {
+                return {r.ptr, r.ec, count};
+            }
+            ++count;
+            p = r.ptr;
+            if (p == last) {
+                break;
+            }
+            if (*p != delimiter) {
+                return {p, std::errc::invalid_argument, count};
+            }
+            ++p;
+        }
+        return {p, std::errc(), count};
+    }
+
+    /// Like `std::to_chars_result`
+    struct to_chars_result {
+        char* ptr;
+        std::errc ec;
+    };
+
+    /// Most chars `to_chars` writes for an `Int` in `base`, with a sign
+    template <typename Int>
+    EKUTIL_CONSTEXPR int max_chars(int base = 10) noexcept
+    {
+        return max_digits<Int>(base) + (std::is_signed<Int>::value ? 1 : 0);
+    }
+
+    /// "00" to "99", for writing decimals two digits at a time
+    inline const char* _digit_pairs() noexcept
+    {
+        static const char pairs[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+        return pairs;
+    }
+
+    /// Number of decimal digits of `v`: estimated from its bit length
+    /// (times log10(2) ~ 1233 / 4096), and corrected by one comparison
+    inline int _decimal_length(uint64_t v) noexcept
+    {
+        static const uint64_t powers[] = {0,
+                                          10,
+                                          100,
+                                          1000,
+                                          10000,
+                                          100000,
+                                          1000000,
+                                          10000000,
+                                          100000000,
+                                          1000000000,
+                                          10000000000,
+                                          100000000000,
+                                          1000000000000,
+                                          10000000000000,
+                                          100000000000000,
+                                          1000000000000000,
+                                          10000000000000000,
+                                          100000000000000000,
+                                          1000000000000000000,
+                                          10000000000000000000u};
+        auto t = (64 - countl_zero(v | 1)) * 1233 >> 12;
+        return t - (v < powers[t] ? 1 : 0) + 1;
+    }
+
+    /// Number of digits of `v` in `base`
+    inline int _based_length(uint64_t v, unsigned base) noexcept
+    {
+        if ((base & (base - 1)) == 0) {
+            auto shift = countr_zero(base);
+            return (64 - countl_zero(v | 1) + shift - 1) / shift;
+        }
+        int n = 1;
+        for (; v >= base; v /= base) {
+            ++n;
+        }
+        return n;
+    }
+
+    /// Write the decimal digits of `v`, ending at `end`, two at a time
+    inline void _write_decimal(char* end, uint32_t v) noexcept
+    {
+        auto pairs = _digit_pairs();
+        while (v >= 100) {
+            auto i = static_cast<size_t>(v % 100) * 2;
+            v /= 100;
+            end -= 2;
+            std::memcpy(end, pairs + i, 2);
+        }
+        if (v >= 10) {
+            std::memcpy(end - 2, pairs + static_cast<size_t>(v) * 2, 2);
+        }
+        else {
+            end[-1] = static_cast<char>('0' + v);
+        }
+    }
+    /// Write exactly 8 decimal digits of `v` < 10^8, ending at `end`
+    inline void _write_decimal8(char* end, uint32_t v) noexcept
+    {
+        auto pairs = _digit_pairs();
+        for (int i = 0; i < 4; ++i) {
+            end -= 2;
+            std::memcpy(end, pairs + (v % 100) * 2, 2);
+            v /= 100;
+        }
+    }
+
+    /// Write the digits of `v` in `base`, ending at `end`
+    inline void _write_based(char* end, uint64_t v, unsigned base) noexcept
+    {
+        static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        if ((base & (base - 1)) == 0) {
+            auto shift = countr_zero(base);
+            do {
+                *--end = digits[v & (base - 1)];
+                v >>= shift;
+            } while (v != 0);
+            return;
+        }
+        do {
+            *--end = digits[v % base];
+            v /= base;
+        } while (v != 0);
+    }
+
+    /// `|v|`, and whether `v` is negative
+    template <typename Int>
+    uint64_t _magnitude(Int v, bool& negative, std::true_type) noexcept
+    {
+        auto u = static_cast<uint64_t>(v);
+        negative = v < 0;
+        return negative ? 0 - u : u;
+    }
+    template <typename Int>
+    uint64_t _magnitude(Int v, bool& negative, std::false_type) noexcept
+    {
+        negative = false;
+        return static_cast<uint64_t>(v);
+    }
+
+    /// An integer to format: its sign and magnitude, and the number of
+    /// chars they take
+    struct _formatted_int {
+        template <typename Int>
+        _formatted_int(Int value, int b) noexcept : base(b)
+        {
+            static_assert(std::is_integral<Int>::value &&
+                              !std::is_same<Int, bool>::value,
+                          "to_chars: Int must be an integer type");
+            magnitude = _magnitude(value, negative, std::is_signed<Int>{});
+            size = base == 10 ? _decimal_length(magnitude)
+                              : _based_length(magnitude,
+                                              static_cast<unsigned>(base));
+            size += negative ? 1 : 0;
+        }
+
+        /// Write the `size` chars at `first`
+        void write(char* first) const noexcept
+        {
+            if (negative) {
+                *first = '-';
+            }
+            auto end = first + size;
+            if (base != 10) {
+                _write_based(end, magnitude, static_cast<unsigned>(base));
+            }
+            else {
+                // In 8-digit pieces, to use 32-bit divisions, which are
+                // faster
+                auto v = magnitude;
+                while (v > 0xffffffff) {
+                    _write_decimal8(end, static_cast<uint32_t>(v % 100000000));
+                    v /= 100000000;
+                    end -= 8;
+                }
+                _write_decimal(end, static_cast<uint32_t>(v));
+            }
+        }
+
+        uint64_t magnitude;
+        int base;
+        int size;
+        bool negative;
+    };
+
+    /**
+     * Format an integer into `[first, last)`, like `std::to_chars`: a '-'
+     * if negative, and digits in `base` (2 to 36, lowercase letters).
+     * Returns `std::errc::value_too_large` and `last` if it doesn't fit;
+     * `max_chars<Int>(base)` always does.
+     * The length is computed first, from the bit length, and decimals
+     * are then written backwards two digits at a time.
+     */
+    template <typename Int>
+    to_chars_result to_chars(char* first,
+                             char* last,
+                             Int value,
+                             int base = 10) noexcept
+    {
+        _formatted_int f(value, base);
+        if (last - first < f.size) {
+            return {last, std::errc::value_too_large};
+        }
+        f.write(first);
+        return {first + f.size, std::errc()};
+    }
+    template <typename Int>
+    to_chars_result to_chars(span<char> out, Int value, int base = 10) noexcept
+    {
+        return to_chars(out.data(), out.data() + out.size(), value, base);
+    }
+
+    /// Append an integer formatted as by `to_chars` to `out`, and return a
+    /// view of it
+    template <typename Int, typename Allocator, typename GrowthPolicy>
+    span<char> append_chars(
+        small_vector_base<char, Allocator, GrowthPolicy>& out,
+        Int value,
+        int base = 10)
+    {
+        _formatted_int f(value, base);
+        auto s = out.append_for_overwrite(static_cast<size_t>(f.size));
+        f.write(s.data());
+        return s;
+    }
+}  // namespace ekutil
+
+#endif  // EKUTIL_CHARCONV_H
@@ -18,10 +18,19 @@
 #ifndef EKUTIL_BITS_COMPAT_H
 #define EKUTIL_BITS_COMPAT_H
 
+// For the standard library's version macros (_GLIBCXX_RELEASE)
+#include <cstddef>
+
 #define EKUTIL_STD_11 201103L
 #define EKUTIL_STD_14 201402L
 #define EKUTIL_STD_17 201703L
 
+#if defined(_MSVC_LANG)
+#define EKUTIL_MSVC_LANG _MSVC_LANG
+#else
+#define EKUTIL_MSVC_LANG 0
+#endif
+
 #define EKUTIL_COMPILER(major, minor, patch) \
     ((major)*10000000 /* 10,000,000 */ + (minor)*10000 /* 10,000 */ + (patch))
 #define EKUTIL_VERSION EKUTIL_COMPILER(0, 0, 1)
@@ -196,10 +205,13 @@
 #if (defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201606) || \
     EKUTIL_HAS_INCLUDE(<charconv>)
 
-#if defined(_GLIBCXX_RELEASE) && _GLIBCXX_RELEASE >= EKUTIL_COMPILER(8, 1, 0)
+// _GLIBCXX_RELEASE is only the major version
+#if defined(_GLIBCXX_RELEASE) && _GLIBCXX_RELEASE >= 8 && \
+    __cplusplus >= EKUTIL_STD_17
 #define EKUTIL_HAS_INTEGER_CHARCONV 1
 #define EKUTIL_HAS_FLOAT_CHARCONV 0
-#elif EKUTIL_MSVC >= EKUTIL_COMPILER(19, 14, 0)
+#elif EKUTIL_MSVC >= EKUTIL_COMPILER(19, 14, 0) && \
+    EKUTIL_MSVC_LANG >= EKUTIL_STD_17
 #define EKUTIL_HAS_INTEGER_CHARCONV 1
 #define EKUTIL_HAS_FLOAT_CHARCONV 0
 #endif
@@ -282,10 +294,79 @@
 #define EKUTIL_UNLIKELY(x) (x)
 #endif
 
+// Detect the bit counting builtins: __builtin_ctz(ll) and
+// __builtin_clz(ll)
+#if EKUTIL_HAS_BUILTIN(__builtin_ctz) || EKUTIL_GCC || EKUTIL_CLANG
+#define EKUTIL_HAS_BUILTIN_BIT_COUNT 1
+#else
+#define EKUTIL_HAS_BUILTIN_BIT_COUNT 0
+#endif
+
+// Detect unsigned __int128, for the 64x64->128-bit multiply in hash.h.
+#if defined(__SIZEOF_INT128__)
+#define EKUTIL_HAS_INT128 1
+#else
+#define EKUTIL_HAS_INT128 0
+#endif
+
+// Detect little-endian byte order, for the SWAR parsing in charconv.h
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    EKUTIL_MSVC
+#define EKUTIL_LITTLE_ENDIAN 1
+#else
+#define EKUTIL_LITTLE_ENDIAN 0
+#endif
+
+// Detect SSE2 and AVX2, for the string search kernels.
+// Define EKUTIL_NO_SIMD to 1 to use the scalar versions instead.
+#ifndef EKUTIL_NO_SIMD
+#define EKUTIL_NO_SIMD 0
+#endif
+
+#if !EKUTIL_NO_SIMD &&                                            \
+    (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define EKUTIL_HAS_SSE2 1
+#else
+#define EKUTIL_HAS_SSE2 0
+#endif
+
+#if EKUTIL_HAS_SSE2 && defined(__AVX2__)
+#define EKUTIL_HAS_AVX2 1
+#else
+#define EKUTIL_HAS_AVX2 0
+#endif
+
 #define EKUTIL_UNUSED(x) static_cast<void>(sizeof(x))
 
 #ifndef EKUTIL_STL_OVERLOADS
 #define EKUTIL_STL_OVERLOADS 1
 #endif
 
+// Count spills and reallocations of every small_vector instantiation,
+// see small_vector_stats
+#ifndef EKUTIL_SMALL_VECTOR_STATS
+#define EKUTIL_SMALL_VECTOR_STATS 0
+#endif
+
+// Detect mmap, for large_buffer_allocator
+#ifndef EKUTIL_HAS_MMAP
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define EKUTIL_HAS_MMAP 1
+#else
+#define EKUTIL_HAS_MMAP 0
+#endif
+#endif
+
+// Size of a cache line, the granularity of false sharing.
+// std::hardware_destructive_interference_size may change between compiler
+// flags, which makes it unfit for layouts in headers, so it's not used.
+#ifndef EKUTIL_CACHE_LINE_SIZE
+#if defined(__powerpc64__) || (defined(__aarch64__) && defined(__APPLE__))
+#define EKUTIL_CACHE_LINE_SIZE 128
+#else
+#define EKUTIL_CACHE_LINE_SIZE 64
+#endif
+#endif
+
 #endif  // EKUTIL_BITS_COMPAT_H
@@ -0,0 +1,507 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_FUNCTION_H
+#define EKUTIL_FUNCTION_H
+
+#include "memory.h"
+#include "meta.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ekutil {
+    /// Whether an `F&` can be called with `Args...`, returning something
+    /// convertible to `R`
+    template <typename F, typename Signature, typename = void>
+    struct is_callable_as : std::false_type {
+    };
+    template <typename F, typename R, typename... Args>
+    struct is_callable_as<
+        F,
+        R(Args...),
+        void_t<decltype(std::declval<F&>()(std::declval<Args>()...))>>
+        : std::integral_constant<
+              bool,
+              std::is_void<R>::value ||
+                  std::is_convertible<decltype(std::declval<F&>()(
+                                          std::declval<Args>()...)),
+                                      R>::value> {
+    };
+
+    /// Allocator of `inplace_function`, which never allocates
+    struct no_allocator {
+    };
+
+    /**
+     * Operations on a callable stored in the buffer of a type-erased
+     * function: one static table per callable type, so that the function
+     * object itself holds a single pointer to it.
+     */
+    template <typename Allocator, typename R, typename... Args>
+    struct function_vtable {
+        R (*invoke)(void* obj, Args&&... args);
+        void (*copy)(void* dst, const void* src, Allocator& alloc);
+        /// Move `src` to `dst`, and destroy `src`
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void* obj, Allocator& alloc);
+    };
+
+    /// Table of an empty function: calling it throws
+    /// `std::bad_function_call`
+    template <typename Allocator, typename R, typename... Args>
+    struct empty_function_vtable {
+        static R invoke(void*, Args&&...)
+        {
+            throw std::bad_function_call{};
+        }
+        static void copy(void*, const void*, Allocator&) {}
+        static void relocate(void*, void*) {}
+        static void destroy(void*, Allocator&) {}
+
+        static const function_vtable<Allocator, R, Args...> value;
+    };
+    template <typename Allocator, typename R, typename... Args>
+    const function_vtable<Allocator, R, Args...>
+        empty_function_vtable<Allocator, R, Args...>::value = {
+            &invoke, &copy, &relocate, &destroy};
+
+    /// Table of an `F` stored in the buffer itself
+    template <typename F, typename Allocator, typename R, typename... Args>
+    struct inline_function_vtable {
+        static F& get(void* obj) noexcept
+        {
+            return *static_cast<F*>(obj);
+        }
+
+        template <typename G>
+        static void create(void* obj, Allocator&, G&& f)
+        {
+            ::new (obj) F(std::forward<G>(f));
+        }
+
+        static R invoke(void* obj, Args&&... args)
+        {
+            return static_cast<R>(get(obj)(std::forward<Args>(args)...));
+        }
+        static void copy(void* dst, const void* src, Allocator&)
+        {
+            ::new (dst) F(*static_cast<const F*>(src));
+        }
+        static void relocate(void* dst, void* src)
+        {
+            ::new (dst) F(std::move(get(src)));
+            get(src).~F();
+        }
+        static void destroy(void* obj, Allocator&)
+        {
+            get(obj).~F();
+        }
+
+        static const function_vtable<Allocator, R, Args...> value;
+    };
+    template <typename F, typename Allocator, typename R, typename... Args>
+    const function_vtable<Allocator, R, Args...>
+        inline_function_vtable<F, Allocator, R, Args...>::value = {
+            &invoke, &copy, &relocate, &destroy};
+
+    /// Table of an `F` allocated with `Allocator`, the buffer holding a
+    /// pointer to it
+    template <typename F, typename Allocator, typename R, typename... Args>
+    struct heap_function_vtable {
+        using alloc_traits = typename std::allocator_traits<
+            Allocator>::template rebind_traits<F>;
+        using allocator_type = typename alloc_traits::allocator_type;
+
+        static F*& get(void* obj) noexcept
+        {
+            return *static_cast<F**>(obj);
+        }
+
+        template <typename G>
+        static void create(void* obj, Allocator& alloc, G&& f)
+        {
+            allocator_type a(alloc);
+            auto p = alloc_traits::allocate(a, 1);
+            try {
+                ::new (static_cast<void*>(p)) F(std::forward<G>(f));
+            }
+            catch (...) {
+                alloc_traits::deallocate(a, p, 1);
+                throw;
+            }
+            get(obj) = p;
+        }
+
+        static R invoke(void* obj, Args&&... args)
+        {
+            return static_cast<R>((*get(obj))(std::forward<Args>(args)...));
+        }
+        static void copy(void* dst, const void* src, Allocator& alloc)
+        {
+            create(dst, alloc, **static_cast<F* const*>(src));
+        }
+        static void relocate(void* dst, void* src)
+        {
+            get(dst) = get(src);
+        }
+        static void destroy(void* obj, Allocator& alloc)
+        {
+            allocator_type a(alloc);
+            get(obj)->~F();
+            alloc_traits::deallocate(a, get(obj), 1);
+        }
+
+        static const function_vtable<Allocator, R, Args...> value;
+    };
+    template <typename F, typename Allocator, typename R, typename... Args>
+    const function_vtable<Allocator, R, Args...>
+        heap_function_vtable<F, Allocator, R, Args...>::value = {
+            &invoke, &copy, &relocate, &destroy};
+
+    template <typename F>
+    EKUTIL_CONSTEXPR bool is_null_callable(const F&) noexcept
+    {
+        return false;
+    }
+    template <typename F>
+    EKUTIL_CONSTEXPR bool is_null_callable(F* f) noexcept
+    {
+        return f == nullptr;
+    }
+
+    EKUTIL_CLANG_PUSH
+    EKUTIL_CLANG_IGNORE("-Wpadded")
+
+    template <typename Signature,
+              size_t Capacity = 32,
+              size_t Align = alignof(std::max_align_t)>
+    class inplace_function;
+
+    /**
+     * `std::function` that never allocates: the callable is stored in a
+     * buffer of `Capacity` bytes, aligned to `Align`, inside the object.
+     * A callable that doesn't fit is a compile-time error.
+     * Calls go through a single pointer to a static table of operations.
+     */
+    template <typename R, typename... Args, size_t Capacity, size_t Align>
+    class inplace_function<R(Args...), Capacity, Align> {
+        using vtable = function_vtable<no_allocator, R, Args...>;
+        using empty_vtable = empty_function_vtable<no_allocator, R, Args...>;
+
+        template <typename F>
+        using enable_if_callable = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type,
+                          inplace_function>::value &&
+            is_callable_as<typename std::decay<F>::type,
+                           R(Args...)>::value>::type;
+
+        static_assert(Capacity > 0, "inplace_function: Capacity is 0");
+
+    public:
+        using result_type = R;
+
+        inplace_function() noexcept : m_vtable(&empty_vtable::value) {}
+        inplace_function(std::nullptr_t) noexcept : inplace_function() {}
+
+        template <typename F, typename = enable_if_callable<F>>
+        inplace_function(F&& f) : inplace_function()
+        {
+            using fn_type = typename std::decay<F>::type;
+            static_assert(sizeof(fn_type) <= Capacity,
+                          "inplace_function: callable larger than Capacity");
+            static_assert(Align % alignof(fn_type) == 0,
+                          "inplace_function: callable over-aligned");
+            static_assert(std::is_nothrow_move_constructible<fn_type>::value,
+                          "inplace_function: callable move may throw");
+            using fn_vtable =
+                inline_function_vtable<fn_type, no_allocator, R, Args...>;
+
+            if (is_null_callable(f)) {
+                return;
+            }
+            no_allocator a;
+            fn_vtable::create(&m_storage, a, std::forward<F>(f));
+            m_vtable = &fn_vtable::value;
+        }
+
+        inplace_function(const inplace_function& other)
+            : m_vtable(other.m_vtable)
+        {
+            no_allocator a;
+            m_vtable->copy(&m_storage, &other.m_storage, a);
+        }
+        inplace_function(inplace_function&& other) noexcept
+            : m_vtable(other.m_vtable)
+        {
+            m_vtable->relocate(&m_storage, &other.m_storage);
+            other.m_vtable = &empty_vtable::value;
+        }
+
+        inplace_function& operator=(const inplace_function& other)
+        {
+            if (this != std::addressof(other)) {
+                *this = inplace_function(other);
+            }
+            return *this;
+        }
+        inplace_function& operator=(inplace_function&& other) noexcept
+        {
+            if (this != std::addressof(other)) {
+                _destroy();
+                m_vtable = other.m_vtable;
+                m_vtable->relocate(&m_storage, &other.m_storage);
+                other.m_vtable = &empty_vtable::value;
+            }
+            return *this;
+        }
+        inplace_function& operator=(std::nullptr_t) noexcept
+        {
+            _destroy();
+            m_vtable = &empty_vtable::value;
+            return *this;
+        }
+        template <typename F, typename = enable_if_callable<F>>
+        inplace_function& operator=(F&& f)
+        {
+            return *this = inplace_function(std::forward<F>(f));
+        }
+
+        ~inplace_function()
+        {
+            _destroy();
+        }
+
+        R operator()(Args... args) const
+        {
+            return m_vtable->invoke(&m_storage, std::forward<Args>(args)...);
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_vtable != &empty_vtable::value;
+        }
+
+        void swap(inplace_function& other) noexcept
+        {
+            std::swap(*this, other);
+        }
+
+    private:
+        void _destroy() noexcept
+        {
+            no_allocator a;
+            m_vtable->destroy(&m_storage, a);
+        }
+
+        const vtable* m_vtable;
+        mutable typename std::aligned_storage<Capacity, Align>::type m_storage;
+    };
+
+    template <typename Signature,
+              size_t Capacity = 32,
+              typename Allocator = std::allocator<char>>
+    class small_function;
+
+    /**
+     * `std::function` storing callables of up to `Capacity` bytes inside
+     * the object, and larger ones (or ones that may throw on move) with
+     * `Allocator`: for example `arena_allocator<char>` to allocate from a
+     * `monotonic_arena`.
+     * The allocator travels with the callable: assignment replaces it.
+     */
+    template <typename R,
+              typename... Args,
+              size_t Capacity,
+              typename Allocator>
+    class small_function<R(Args...), Capacity, Allocator>
+        : private ebo_storage<Allocator> {
+        using alloc_base = ebo_storage<Allocator>;
+        using vtable = function_vtable<Allocator, R, Args...>;
+        using empty_vtable = empty_function_vtable<Allocator, R, Args...>;
+        using storage_type =
+            typename std::aligned_storage<Capacity < sizeof(void*)
+                                              ? sizeof(void*)
+                                              : Capacity>::type;
+
+        template <typename F>
+        using enable_if_callable = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type,
+                          small_function>::value &&
+            is_callable_as<typename std::decay<F>::type,
+                           R(Args...)>::value>::type;
+
+    public:
+        using result_type = R;
+        using allocator_type = Allocator;
+
+        /// Whether an `F` is stored inside the object
+        template <typename F>
+        static EKUTIL_CONSTEXPR bool is_stored_inline() noexcept
+        {
+            return sizeof(F) <= sizeof(storage_type) &&
+                   alignof(storage_type) % alignof(F) == 0 &&
+                   std::is_nothrow_move_constructible<F>::value;
+        }
+
+        small_function() noexcept(
+            std::is_nothrow_default_constructible<Allocator>::value)
+            : small_function(Allocator{})
+        {
+        }
+        explicit small_function(const Allocator& alloc) noexcept
+            : alloc_base(alloc), m_vtable(&empty_vtable::value)
+        {
+        }
+        small_function(std::nullptr_t,
+                       const Allocator& alloc = Allocator{}) noexcept
+            : small_function(alloc)
+        {
+        }
+
+        template <typename F, typename = enable_if_callable<F>>
+        small_function(F&& f, const Allocator& alloc = Allocator{})
+            : small_function(alloc)
+        {
+            using fn_type = typename std::decay<F>::type;
+            using fn_vtable = typename std::conditional<
+                is_stored_inline<fn_type>(),
+                inline_function_vtable<fn_type, Allocator, R, Args...>,
+                heap_function_vtable<fn_type, Allocator, R, Args...>>::type;
+
+            if (is_null_callable(f)) {
+                return;
+            }
+            fn_vtable::create(&m_storage, _get_allocator(),
+                              std::forward<F>(f));
+            m_vtable = &fn_vtable::value;
+        }
+
+        small_function(const small_function& other)
+            : small_function(
+                  std::allocator_traits<Allocator>::
+                      select_on_container_copy_construction(
+                          other._get_allocator()))
+        {
+            other.m_vtable->copy(&m_storage, &other.m_storage,
+                                 _get_allocator());
+            m_vtable = other.m_vtable;
+        }
+        small_function(small_function&& other) noexcept
+            : alloc_base(std::move(other._get_allocator())),
+              m_vtable(other.m_vtable)
+        {
+            m_vtable->relocate(&m_storage, &other.m_storage);
+            other.m_vtable = &empty_vtable::value;
+        }
+
+        small_function& operator=(const small_function& other)
+        {
+            if (this != std::addressof(other)) {
+                *this = small_function(other);
+            }
+            return *this;
+        }
+        small_function& operator=(small_function&& other) noexcept
+        {
+            if (this != std::addressof(other)) {
+                _destroy();
+                _get_allocator() = std::move(other._get_allocator());
+                m_vtable = other.m_vtable;
+                m_vtable->relocate(&m_storage, &other.m_storage);
+                other.m_vtable = &empty_vtable::value;
+            }
+            return *this;
+        }
+        small_function& operator=(std::nullptr_t) noexcept
+        {
+            _destroy();
+            m_vtable = &empty_vtable::value;
+            return *this;
+        }
+        template <typename F, typename = enable_if_callable<F>>
+        small_function& operator=(F&& f)
+        {
+            return *this =
+                       small_function(std::forward<F>(f), _get_allocator());
+        }
+
+        ~small_function()
+        {
+            _destroy();
+        }
+
+        R operator()(Args... args) const
+        {
+            return m_vtable->invoke(&m_storage, std::forward<Args>(args)...);
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_vtable != &empty_vtable::value;
+        }
+
+        allocator_type get_allocator() const noexcept
+        {
+            return _get_allocator();
+        }
+
+        void swap(small_function& other) noexcept
+        {
+            std::swap(*this, other);
+        }
+
+    private:
+        Allocator& _get_allocator() noexcept
+        {
+            return alloc_base::get_value();
+        }
+        const Allocator& _get_allocator() const noexcept
+        {
+            return alloc_base::get_value();
+        }
+
+        void _destroy() noexcept
+        {
+            m_vtable->destroy(&m_storage, _get_allocator());
+        }
+
+        const vtable* m_vtable;
+        mutable storage_type m_storage;
+    };
+
+    EKUTIL_CLANG_POP
+
+    template <typename Signature, size_t Capacity, size_t Align>
+    void swap(inplace_function<Signature, Capacity, Align>& a,
+              inplace_function<Signature, Capacity, Align>& b) noexcept
+    {
+        a.swap(b);
+    }
+    template <typename Signature, size_t Capacity, typename Allocator>
+    void swap(small_function<Signature, Capacity, Allocator>& a,
+              small_function<Signature, Capacity, Allocator>& b) noexcept
+    {
+        a.swap(b);
+    }
+}  // namespace ekutil
+
+#endif  // EKUTIL_FUNCTION_H
@@ -0,0 +1,289 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_HASH_H
+#define EKUTIL_HASH_H
+
+#include "span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if !EKUTIL_HAS_INT128 && EKUTIL_MSVC && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace ekutil {
+    /**
+     * Whether the bytes of a `T` are all of its value, and equal values
+     * have equal bytes, so that it can be hashed as bytes: integers,
+     * enums and pointers. Not floating point numbers (0.0 and -0.0).
+     * Specialize this for other types for which that holds, to hash spans
+     * of them.
+     */
+    template <typename T>
+    struct is_trivially_hashable
+        : std::integral_constant<bool,
+                                 std::is_integral<T>::value ||
+                                     std::is_enum<T>::value ||
+                                     std::is_pointer<T>::value> {
+    };
+
+    /// 64x64->128-bit multiplication: `a` gets the low half of the
+    /// product, `b` the high half
+    inline void _mul128(uint64_t& a, uint64_t& b) noexcept
+    {
+#if EKUTIL_HAS_INT128
+        auto r = static_cast<__uint128_t>(a) * b;
+        a = static_cast<uint64_t>(r);
+        b = static_cast<uint64_t>(r >> 64);
+#elif EKUTIL_MSVC && defined(_M_X64)
+        a = _umul128(a, b, &b);
+#else
+        auto ha = a >> 32, hb = b >> 32;
+        auto la = a & 0xffffffff, lb = b & 0xffffffff;
+        auto hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+        auto t = ll + (hl << 32);
+        auto carry = static_cast<uint64_t>(t < ll);
+        auto lo = t + (lh << 32);
+        carry += static_cast<uint64_t>(lo < t);
+        a = lo;
+        b = hh + (hl >> 32) + (lh >> 32) + carry;
+#endif
+    }
+    /// Fold the 128-bit product of `a` and `b` to 64 bits
+    inline uint64_t _hash_mix(uint64_t a, uint64_t b) noexcept
+    {
+        _mul128(a, b);
+        return a ^ b;
+    }
+
+    inline uint64_t _hash_read8(const unsigned char* p) noexcept
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+    inline uint64_t _hash_read4(const unsigned char* p) noexcept
+    {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+    /// 1 to 3 bytes
+    inline uint64_t _hash_read3(const unsigned char* p, size_t n) noexcept
+    {
+        return (uint64_t{p[0]} << 16) | (uint64_t{p[n >> 1]} << 8) |
+               p[n - 1];
+    }
+
+    struct _hash_secret {
+        static EKUTIL_CONSTEXPR_DECL const uint64_t s0 = 0x2d358dccaa6c78a5;
+        static EKUTIL_CONSTEXPR_DECL const uint64_t s1 = 0x8bb84b93962eacc9;
+        static EKUTIL_CONSTEXPR_DECL const uint64_t s2 = 0x4b33a62ed433d4a3;
+        static EKUTIL_CONSTEXPR_DECL const uint64_t s3 = 0x4d5a2da51de1aa47;
+    };
+
+    /// The last step of `hash_bytes`, for up to 16 bytes `[p, p + n)`,
+    /// of a message of `len` bytes
+    inline uint64_t _hash_short(const unsigned char* p,
+                                size_t n,
+                                size_t len,
+                                uint64_t seed) noexcept
+    {
+        uint64_t a = 0, b = 0;
+        if (n >= 4) {
+            auto mid = (n >> 3) << 2;
+            a = (_hash_read4(p) << 32) | _hash_read4(p + mid);
+            b = (_hash_read4(p + n - 4) << 32) | _hash_read4(p + n - 4 - mid);
+        }
+        else if (n > 0) {
+            a = _hash_read3(p, n);
+        }
+        a ^= _hash_secret::s1;
+        b ^= seed;
+        _mul128(a, b);
+        return _hash_mix(a ^ _hash_secret::s0 ^ len, b ^ _hash_secret::s1);
+    }
+
+    /// The last step of `hash_bytes`, for more than 16, up to 48 bytes
+    /// `[p, p + n)`, with the 16 bytes before `p` readable if `n` < 16
+    inline uint64_t _hash_tail(const unsigned char* p,
+                               size_t n,
+                               size_t len,
+                               uint64_t seed) noexcept
+    {
+        while (n > 16) {
+            seed = _hash_mix(_hash_read8(p) ^ _hash_secret::s1,
+                             _hash_read8(p + 8) ^ seed);
+            p += 16;
+            n -= 16;
+        }
+        auto a = _hash_read8(p + n - 16) ^ _hash_secret::s1;
+        auto b = _hash_read8(p + n - 8) ^ seed;
+        _mul128(a, b);
+        return _hash_mix(a ^ _hash_secret::s0 ^ len, b ^ _hash_secret::s1);
+    }
+
+    /// Three independent lanes over a 48-byte stripe
+    inline void _hash_stripe(const unsigned char* p,
+                             uint64_t& seed,
+                             uint64_t& see1,
+                             uint64_t& see2) noexcept
+    {
+        seed = _hash_mix(_hash_read8(p) ^ _hash_secret::s1,
+                         _hash_read8(p + 8) ^ seed);
+        see1 = _hash_mix(_hash_read8(p + 16) ^ _hash_secret::s2,
+                         _hash_read8(p + 24) ^ see1);
+        see2 = _hash_mix(_hash_read8(p + 32) ^ _hash_secret::s3,
+                         _hash_read8(p + 40) ^ see2);
+    }
+
+    inline uint64_t _hash_seed(uint64_t seed) noexcept
+    {
+        return seed ^ _hash_mix(seed ^ _hash_secret::s0, _hash_secret::s1);
+    }
+
+    /**
+     * Hash `n` bytes at `data`, following wyhash (final version 4): 48
+     * bytes per iteration in three independent multiply-xor lanes, and
+     * only a couple of multiplications for short inputs.
+     * Not cryptographic, and the values may differ between platforms
+     * (byte order) and versions of this library: don't persist them.
+     */
+    inline uint64_t hash_bytes(const void* data,
+                               size_t n,
+                               uint64_t seed = 0) noexcept
+    {
+        auto p = static_cast<const unsigned char*>(data);
+        seed = _hash_seed(seed);
+        if (n <= 16) {
+            return _hash_short(p, n, n, seed);
+        }
+        auto i = n;
+        if (i > 48) {
+            auto see1 = seed, see2 = seed;
+            do {
+                _hash_stripe(p, seed, see1, see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        return _hash_tail(p, i, n, seed);
+    }
+
+    /// Hash the elements of `s` as bytes
+    template <typename T>
+    uint64_t hash(span<T> s, uint64_t seed = 0) noexcept
+    {
+        static_assert(
+            is_trivially_hashable<typename std::remove_cv<T>::type>::value,
+            "hash: T can't be hashed as bytes, see is_trivially_hashable");
+        return hash_bytes(s.data(),
+                          static_cast<size_t>(s.size()) * sizeof(T), seed);
+    }
+
+    /**
+     * Hash a message given in pieces: the result is the same as
+     * `hash_bytes` of all of them concatenated, with the same seed.
+     */
+    class hasher {
+    public:
+        explicit hasher(uint64_t seed = 0) noexcept
+            : m_seed(_hash_seed(seed)), m_see1(m_seed), m_see2(m_seed)
+        {
+        }
+
+        hasher& update(const void* data, size_t n) noexcept
+        {
+            auto p = static_cast<const unsigned char*>(data);
+            m_len += n;
+            if (m_buffered + n <= stripe) {
+                std::memcpy(m_buffer + history + m_buffered, p, n);
+                m_buffered += n;
+                return *this;
+            }
+
+            // More data follows: the buffered stripe can be hashed
+            if (m_buffered != 0) {
+                auto fill = stripe - m_buffered;
+                std::memcpy(m_buffer + history + m_buffered, p, fill);
+                p += fill;
+                n -= fill;
+                _stripe(m_buffer + history);
+            }
+            while (n > stripe) {
+                _stripe(p);
+                p += stripe;
+                n -= stripe;
+            }
+            std::memcpy(m_buffer + history, p, n);
+            m_buffered = n;
+            return *this;
+        }
+        template <typename T>
+        hasher& update(span<T> s) noexcept
+        {
+            static_assert(
+                is_trivially_hashable<typename std::remove_cv<T>::type>::value,
+                "hasher: T can't be hashed as bytes, see "
+                "is_trivially_hashable");
+            return update(s.data(),
+                          static_cast<size_t>(s.size()) * sizeof(T));
+        }
+
+        /// The hash of everything so far; more can still be added
+        uint64_t digest() const noexcept
+        {
+            auto tail = m_buffer + history;
+            if (!m_striped) {
+                if (m_len <= 16) {
+                    return _hash_short(tail, m_buffered, m_len, m_seed);
+                }
+                return _hash_tail(tail, m_buffered, m_len, m_seed);
+            }
+            return _hash_tail(tail, m_buffered, m_len,
+                              m_seed ^ m_see1 ^ m_see2);
+        }
+
+    private:
+        static EKUTIL_CONSTEXPR_DECL const size_t stripe = 48;
+        static EKUTIL_CONSTEXPR_DECL const size_t history = 16;
+
+        void _stripe(const unsigned char* p) noexcept
+        {
+            _hash_stripe(p, m_seed, m_see1, m_see2);
+            // The tail may read up to 16 bytes back
+            std::memcpy(m_buffer, p + stripe - history, history);
+            m_striped = true;
+        }
+
+        uint64_t m_seed;
+        uint64_t m_see1;
+        uint64_t m_see2;
+        uint64_t m_len{0};
+        size_t m_buffered{0};
+        bool m_striped{false};
+        /// The last 16 bytes hashed, followed by the unhashed ones
+        unsigned char m_buffer[history + stripe];
+    };
+}  // namespace ekutil
+
+#endif  // EKUTIL_HASH_H
@@ -19,16 +19,48 @@
 #define EKUTIL_MEMORY_H
 
 #include "meta.h"
+#include "numeric.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <new>
+#include <thread>
 #include <type_traits>
+#include <vector>
+
+#if EKUTIL_HAS_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+#define EKUTIL_HAS_MREMAP 1
+#endif
+#endif
+#ifndef EKUTIL_HAS_MREMAP
+#define EKUTIL_HAS_MREMAP 0
+#endif
 
 namespace ekutil {
-    template <typename... Types>
-    struct aligned_union {
+    /// Objects written by different threads should be at least this far
+    /// apart, to not share a cache line
+    EKUTIL_CONSTEXPR_DECL const size_t hardware_destructive_interference_size =
+        EKUTIL_CACHE_LINE_SIZE;
+    /// Objects read together should fit in this many bytes, to share a
+    /// cache line
+    EKUTIL_CONSTEXPR_DECL const size_t hardware_constructive_interference_size =
+        EKUTIL_CACHE_LINE_SIZE;
+
+    /// Storage for any of `Types...`, aligned to at least `Align`
+    template <size_t Align, typename... Types>
+    struct over_aligned_union {
         static EKUTIL_CONSTEXPR const size_t alignment_value =
-            constexpr_max(alignof(Types)...);
+            constexpr_max(Align, alignof(Types)...);
         static EKUTIL_CONSTEXPR const size_t size_value =
             constexpr_max(sizeof(Types)...);
         struct type {
@@ -36,89 +68,527 @@ namespace ekutil {
         };
     };
 
+    template <typename... Types>
+    struct aligned_union : over_aligned_union<1, Types...> {
+    };
+
+    /// Uninitialized storage for one `T`
+    template <typename T>
+    using basic_stack_storage_type =
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    /// Uninitialized storage for one `T`, starting a cache line and padded
+    /// to a whole number of them
+    template <typename T,
+              size_t Align = hardware_destructive_interference_size>
+    using over_aligned_storage_type =
+        typename over_aligned_union<Align, T>::type;
+
+    EKUTIL_CLANG_PUSH
+    EKUTIL_CLANG_IGNORE("-Wpadded")
+
+    /**
+     * A `T` alone on its cache line(s): aligned to, and padded to a
+     * multiple of `Align` bytes, so that writes to its neighbours don't
+     * slow down other threads reading or writing it.
+     * An aggregate: initialize with `cacheline_padded<T>{value}`.
+     * Before C++17, `new` ignores the alignment; see
+     * `distributed_counter_array` for allocating arrays of these.
+     */
+    template <typename T,
+              size_t Align = hardware_destructive_interference_size>
+    struct alignas(Align) cacheline_padded {
+        T value;
+
+        T& get() noexcept
+        {
+            return value;
+        }
+        const T& get() const noexcept
+        {
+            return value;
+        }
+        T& operator*() noexcept
+        {
+            return value;
+        }
+        const T& operator*() const noexcept
+        {
+            return value;
+        }
+        T* operator->() noexcept
+        {
+            return &value;
+        }
+        const T* operator->() const noexcept
+        {
+            return &value;
+        }
+    };
+
+    EKUTIL_CLANG_POP
+
+    template <typename It>
+    using iter_value_type = typename std::iterator_traits<It>::value_type;
+    template <typename It>
+    using iter_reference = typename std::iterator_traits<It>::reference;
+
+    /// Whether `[first, last)` of `InputIt` can be copied into `ForwardIt`
+    /// with `memcpy`: pointers to the same trivially copyable type
+    template <typename InputIt, typename ForwardIt>
+    struct is_memcpyable_range
+        : std::integral_constant<
+              bool,
+              std::is_pointer<InputIt>::value &&
+                  std::is_pointer<ForwardIt>::value &&
+                  std::is_same<typename std::remove_cv<
+                                   typename std::remove_pointer<
+                                       InputIt>::type>::type,
+                               typename std::remove_pointer<
+                                   ForwardIt>::type>::value &&
+                  std::is_trivially_copyable<
+                      typename std::remove_pointer<ForwardIt>::type>::value> {
+    };
+
+    /// Whether every byte of a `T` is part of its value (no padding), so
+    /// that values can be compared byte by byte
+    template <typename T>
+    struct is_padding_free_scalar
+        : std::integral_constant<bool,
+                                 std::is_integral<T>::value ||
+                                     std::is_enum<T>::value ||
+                                     std::is_pointer<T>::value ||
+                                     std::is_same<T, float>::value ||
+                                     std::is_same<T, double>::value> {
+    };
+
+    /// Destroy `[first, last)`, after a constructor threw
+    template <typename ForwardIt>
+    void _destroy_constructed(ForwardIt first, ForwardIt last) noexcept
+    {
+        using value_type = iter_value_type<ForwardIt>;
+        for (; first != last; ++first) {
+            std::addressof(*first)->~value_type();
+        }
+    }
+
+    template <typename ForwardIt, typename T>
+    void uninitialized_fill(ForwardIt first,
+                            ForwardIt last,
+                            const T& value,
+                            std::false_type)
+    {
+        using value_type = iter_value_type<ForwardIt>;
+        ForwardIt current = first;
+        try {
+            for (; current != last; ++current) {
+                ::new (static_cast<void*>(std::addressof(*current)))
+                    value_type(value);
+            }
+        }
+        catch (...) {
+            _destroy_constructed(first, current);
+            throw;
+        }
+    }
+    template <typename T>
+    void uninitialized_fill(T* first, T* last, const T& value, std::true_type)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, std::addressof(value), sizeof(T));
+        auto n = static_cast<size_t>(last - first);
+        if (n != 0 && std::all_of(bytes, bytes + sizeof(T),
+                                  [&](unsigned char b) {
+                                      return b == bytes[0];
+                                  })) {
+            std::memset(static_cast<void*>(first), bytes[0], n * sizeof(T));
+            return;
+        }
+        // Plain stores, vectorized by the compiler
+        for (; first != last; ++first) {
+            ::new (static_cast<void*>(first)) T(value);
+        }
+    }
+    /**
+     * Copy-construct `value` into `[first, last)`.
+     * Scalars with a repeating byte pattern (like 0) are filled with
+     * `memset`.
+     * If a constructor throws, the elements constructed so far are
+     * destroyed.
+     */
     template <typename ForwardIt, typename T>
     void uninitialized_fill(ForwardIt first,
                             ForwardIt last,
-                            const T& value) noexcept
+                            const T& value) noexcept(
+        std::is_nothrow_copy_constructible<iter_value_type<ForwardIt>>::value)
+    {
+        ekutil::uninitialized_fill(
+            first, last, value,
+            std::integral_constant<
+                bool, std::is_same<ForwardIt, T*>::value &&
+                          is_padding_free_scalar<T>::value>{});
+    }
+
+    template <typename T, typename ForwardIt>
+    void uninitialized_fill_default_construct(ForwardIt first,
+                                              ForwardIt last,
+                                              std::false_type)
     {
-        using value_type = typename std::iterator_traits<ForwardIt>::value_type;
+        using value_type = iter_value_type<ForwardIt>;
         ForwardIt current = first;
-        for (; current != last; ++current) {
-            ::new (static_cast<void*>(std::addressof(*current)))
-                value_type(value);
+        try {
+            for (; current != last; ++current) {
+                ::new (static_cast<void*>(std::addressof(*current)))
+                    value_type();
+            }
+        }
+        catch (...) {
+            _destroy_constructed(first, current);
+            throw;
         }
     }
     template <typename T, typename ForwardIt>
     void uninitialized_fill_default_construct(ForwardIt first,
-                                              ForwardIt last) noexcept
+                                              ForwardIt last,
+                                              std::true_type)
+    {
+        auto bytes = reinterpret_cast<unsigned char*>(last) -
+                     reinterpret_cast<unsigned char*>(first);
+        if (bytes > 0) {
+            std::memset(static_cast<void*>(first), 0,
+                        static_cast<size_t>(bytes));
+        }
+    }
+    /**
+     * Value-initialize `[first, last)`: scalars become 0, with `memset`.
+     * If a constructor throws, the elements constructed so far are
+     * destroyed.
+     */
+    template <typename T, typename ForwardIt>
+    void uninitialized_fill_default_construct(
+        ForwardIt first,
+        ForwardIt last) noexcept(std::is_nothrow_default_constructible<
+                                 iter_value_type<ForwardIt>>::value)
+    {
+        using value_type = iter_value_type<ForwardIt>;
+        ekutil::uninitialized_fill_default_construct<T>(
+            first, last,
+            std::integral_constant<
+                bool, std::is_pointer<ForwardIt>::value &&
+                          is_padding_free_scalar<value_type>::value>{});
+    }
+
+    template <typename ForwardIt>
+    void uninitialized_default_construct(ForwardIt first,
+                                         ForwardIt last,
+                                         std::false_type)
     {
-        using value_type = typename std::iterator_traits<ForwardIt>::value_type;
+        using value_type = iter_value_type<ForwardIt>;
         ForwardIt current = first;
-        for (; current != last; ++current) {
-            ::new (static_cast<void*>(std::addressof(*current))) value_type();
+        try {
+            for (; current != last; ++current) {
+                ::new (static_cast<void*>(std::addressof(*current)))
+                    value_type;
+            }
+        }
+        catch (...) {
+            _destroy_constructed(first, current);
+            throw;
         }
     }
+    template <typename ForwardIt>
+    void uninitialized_default_construct(ForwardIt, ForwardIt, std::true_type)
+    {
+    }
+    /**
+     * Default-initialize `[first, last)`: trivial types are left
+     * uninitialized, at no cost.
+     * If a constructor throws, the elements constructed so far are
+     * destroyed.
+     */
+    template <typename ForwardIt>
+    void uninitialized_default_construct(
+        ForwardIt first,
+        ForwardIt last) noexcept(std::is_nothrow_default_constructible<
+                                 iter_value_type<ForwardIt>>::value)
+    {
+        ekutil::uninitialized_default_construct(
+            first, last,
+            std::is_trivially_default_constructible<
+                iter_value_type<ForwardIt>>{});
+    }
+
     template <typename InputIt, typename ForwardIt>
     ForwardIt uninitialized_copy(InputIt first,
                                  InputIt last,
-                                 ForwardIt d_first) noexcept
+                                 ForwardIt d_first,
+                                 std::false_type)
     {
-        using value_type = typename std::iterator_traits<ForwardIt>::value_type;
+        using value_type = iter_value_type<ForwardIt>;
         ForwardIt current = d_first;
-        for (; first != last; ++first, (void)++current) {
-            ::new (static_cast<void*>(std::addressof(*current)))
-                value_type(*first);
+        try {
+            for (; first != last; ++first, (void)++current) {
+                ::new (static_cast<void*>(std::addressof(*current)))
+                    value_type(*first);
+            }
+        }
+        catch (...) {
+            _destroy_constructed(d_first, current);
+            throw;
         }
         return current;
     }
+    template <typename T, typename U>
+    U* uninitialized_copy(T* first, T* last, U* d_first, std::true_type)
+    {
+        auto n = static_cast<size_t>(last - first);
+        if (n != 0) {
+            std::memcpy(static_cast<void*>(d_first),
+                        static_cast<const void*>(first), n * sizeof(U));
+        }
+        return d_first + n;
+    }
+    /**
+     * Copy-construct `[first, last)` into the uninitialized range beginning
+     * at `d_first`, with `memcpy` for pointers to trivially copyable types.
+     * The ranges must not overlap.
+     * If a constructor throws, the elements constructed so far are
+     * destroyed.
+     */
+    template <typename InputIt, typename ForwardIt>
+    ForwardIt uninitialized_copy(InputIt first,
+                                 InputIt last,
+                                 ForwardIt d_first) noexcept(
+        std::is_nothrow_constructible<iter_value_type<ForwardIt>,
+                                      iter_reference<InputIt>>::value)
+    {
+        return ekutil::uninitialized_copy(
+            first, last, d_first, is_memcpyable_range<InputIt, ForwardIt>{});
+    }
+
     template <typename InputIt, typename ForwardIt>
     ForwardIt uninitialized_move(InputIt first,
                                  InputIt last,
-                                 ForwardIt d_first) noexcept
+                                 ForwardIt d_first,
+                                 std::false_type)
     {
-        using value_type = typename std::iterator_traits<ForwardIt>::value_type;
-        ForwardIt current = d_first;
-        for (; first != last; ++first, (void)++current) {
-            ::new (static_cast<void*>(std::addressof(*current)))
-                value_type(std::move(*first));
+        return ekutil::uninitialized_copy(std::make_move_iterator(first),
+                                          std::make_move_iterator(last),
+                                          d_first, std::false_type{});
+    }
+    template <typename T, typename U>
+    U* uninitialized_move(T* first, T* last, U* d_first, std::true_type)
+    {
+        return ekutil::uninitialized_copy(first, last, d_first,
+                                          std::true_type{});
+    }
+    /**
+     * Move-construct `[first, last)` into the uninitialized range beginning
+     * at `d_first`, like `uninitialized_copy`.
+     */
+    template <typename InputIt, typename ForwardIt>
+    ForwardIt uninitialized_move(InputIt first,
+                                 InputIt last,
+                                 ForwardIt d_first) noexcept(
+        std::is_nothrow_constructible<
+            iter_value_type<ForwardIt>,
+            iter_reference<std::move_iterator<InputIt>>>::value)
+    {
+        return ekutil::uninitialized_move(
+            first, last, d_first, is_memcpyable_range<InputIt, ForwardIt>{});
+    }
+
+    /**
+     * Whether a `T` can be relocated (moved to a new address, and the old
+     * object destroyed) with a plain byte copy.
+     * Trivially copyable types are detected automatically; specialize this
+     * for other types, for which the byte copy is safe, to opt in.
+     */
+    template <typename T>
+    struct is_trivially_relocatable
+        : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {
+    };
+
+    /**
+     * Holds a `T`, taking up no space if `T` is empty.
+     * Inherit from this to get the empty base optimization.
+     */
+    template <typename T,
+              bool = std::is_empty<T>::value && !__is_final(T)>
+    class ebo_storage : private T {
+    public:
+        EKUTIL_CONSTEXPR ebo_storage() = default;
+        EKUTIL_CONSTEXPR ebo_storage(const T& val) : T(val) {}
+        EKUTIL_CONSTEXPR ebo_storage(T&& val) : T(std::move(val)) {}
+
+        EKUTIL_CONSTEXPR14 T& get_value() noexcept
+        {
+            return *this;
         }
-        return current;
+        EKUTIL_CONSTEXPR const T& get_value() const noexcept
+        {
+            return *this;
+        }
+    };
+    template <typename T>
+    class ebo_storage<T, false> {
+    public:
+        EKUTIL_CONSTEXPR ebo_storage() = default;
+        EKUTIL_CONSTEXPR ebo_storage(const T& val) : m_value(val) {}
+        EKUTIL_CONSTEXPR ebo_storage(T&& val) : m_value(std::move(val)) {}
+
+        EKUTIL_CONSTEXPR14 T& get_value() noexcept
+        {
+            return m_value;
+        }
+        EKUTIL_CONSTEXPR const T& get_value() const noexcept
+        {
+            return m_value;
+        }
+
+    private:
+        T m_value{};
+    };
+
+    template <typename T>
+    void destroy(T* first, T* last, std::true_type) noexcept
+    {
+        EKUTIL_UNUSED(first);
+        EKUTIL_UNUSED(last);
+    }
+    template <typename T>
+    void destroy(T* first, T* last, std::false_type) noexcept
+    {
+        for (; first != last; ++first) {
+            first->~T();
+        }
+    }
+    template <typename T>
+    void destroy(T* first, T* last) noexcept
+    {
+        ekutil::destroy(first, last, std::is_trivially_destructible<T>{});
     }
 
     template <typename T>
-    class unique_ptr {
+    T* uninitialized_relocate(T* first, T* last, T* d_first, std::true_type)
+    {
+        auto n = static_cast<size_t>(last - first);
+        if (n != 0) {
+            // GCC can't tie `n` to the source range when it points into a
+            // zero-sized inline buffer, and warns about a copy never made
+            EKUTIL_GCC_PUSH
+            EKUTIL_GCC_IGNORE("-Warray-bounds")
+            EKUTIL_GCC_IGNORE("-Wstringop-overflow")
+            std::memcpy(static_cast<void*>(d_first),
+                        static_cast<const void*>(first), n * sizeof(T));
+            EKUTIL_GCC_POP
+        }
+        return d_first + n;
+    }
+    template <typename T>
+    T* uninitialized_relocate(T* first, T* last, T* d_first, std::false_type)
+    {
+        for (; first != last; ++first, (void)++d_first) {
+            ::new (static_cast<void*>(d_first)) T(std::move(*first));
+            first->~T();
+        }
+        return d_first;
+    }
+    /**
+     * Move-construct `[first, last)` into the uninitialized range beginning
+     * at `d_first`, and end the lifetime of the source objects.
+     * The ranges must not overlap.
+     */
+    template <typename T>
+    T* uninitialized_relocate(T* first, T* last, T* d_first)
+    {
+        return ekutil::uninitialized_relocate(
+            first, last, d_first, is_trivially_relocatable<T>{});
+    }
+
+    /// What `unique_ptr<T, Deleter>` and `unique_ptr<T[], Deleter>` share
+    template <typename T, typename Deleter>
+    class unique_ptr_base : private ebo_storage<Deleter> {
+        using deleter_base = ebo_storage<Deleter>;
+
     public:
         using element_type = T;
         using pointer = T*;
+        using deleter_type = Deleter;
 
-        EKUTIL_CONSTEXPR unique_ptr() noexcept = default;
-        EKUTIL_CONSTEXPR unique_ptr(std::nullptr_t) noexcept {}
+        EKUTIL_CONSTEXPR unique_ptr_base() noexcept = default;
+        EKUTIL_CONSTEXPR unique_ptr_base(std::nullptr_t) noexcept {}
 
-        EKUTIL_CONSTEXPR explicit unique_ptr(pointer p) : m_ptr(p) {}
+        EKUTIL_CONSTEXPR explicit unique_ptr_base(pointer p) noexcept
+            : m_ptr(p)
+        {
+        }
+        unique_ptr_base(pointer p, const Deleter& d) noexcept
+            : deleter_base(d), m_ptr(p)
+        {
+        }
+        unique_ptr_base(pointer p, Deleter&& d) noexcept
+            : deleter_base(std::move(d)), m_ptr(p)
+        {
+        }
 
-        EKUTIL_CONSTEXPR unique_ptr(const unique_ptr&) = delete;
-        EKUTIL_CONSTEXPR unique_ptr& operator=(const unique_ptr&) = delete;
+        unique_ptr_base(const unique_ptr_base&) = delete;
+        unique_ptr_base& operator=(const unique_ptr_base&) = delete;
 
-        EKUTIL_CONSTEXPR14 unique_ptr(unique_ptr&& p) noexcept
-            : m_ptr(std::move(p.m_ptr))
+        EKUTIL_CONSTEXPR14 unique_ptr_base(unique_ptr_base&& p) noexcept
+            : deleter_base(std::move(p.get_deleter())), m_ptr(p.release())
         {
-            p.m_ptr = nullptr;
         }
-        unique_ptr& operator=(unique_ptr&& p) noexcept
+        unique_ptr_base& operator=(unique_ptr_base&& p) noexcept
+        {
+            reset(p.release());
+            get_deleter() = std::move(p.get_deleter());
+            return *this;
+        }
+        unique_ptr_base& operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        ~unique_ptr_base() noexcept
         {
             if (m_ptr) {
-                delete m_ptr;
+                get_deleter()(m_ptr);
             }
-            m_ptr = p.m_ptr;
-            p.m_ptr = 0;
         }
 
-        ~unique_ptr() noexcept
+        /// Give up ownership, without deleting
+        pointer release() noexcept
         {
-            if (m_ptr) {
-                delete m_ptr;
+            auto p = m_ptr;
+            m_ptr = nullptr;
+            return p;
+        }
+        /// Take ownership of `p`, and delete the old pointer
+        void reset(pointer p = nullptr) noexcept
+        {
+            auto old = m_ptr;
+            m_ptr = p;
+            if (old) {
+                get_deleter()(old);
             }
         }
+        void swap(unique_ptr_base& other) noexcept
+        {
+            using std::swap;
+            swap(m_ptr, other.m_ptr);
+            swap(get_deleter(), other.get_deleter());
+        }
+
+        Deleter& get_deleter() noexcept
+        {
+            return deleter_base::get_value();
+        }
+        const Deleter& get_deleter() const noexcept
+        {
+            return deleter_base::get_value();
+        }
 
         EKUTIL_CONSTEXPR explicit operator bool() const noexcept
         {
@@ -130,124 +600,1994 @@ namespace ekutil {
             return m_ptr;
         }
 
+    private:
+        pointer m_ptr{nullptr};
+    };
+
+    /**
+     * Owning pointer, deleting the object with `Deleter`.
+     * Stateless deleters are stored as an empty base, so that `unique_ptr`
+     * stays the size of a pointer.
+     */
+    template <typename T, typename Deleter = std::default_delete<T>>
+    class unique_ptr : public unique_ptr_base<T, Deleter> {
+        using base = unique_ptr_base<T, Deleter>;
+
+    public:
+        using pointer = typename base::pointer;
+
+        using base::base;
+        EKUTIL_CONSTEXPR unique_ptr() noexcept = default;
+
+        unique_ptr(unique_ptr&&) noexcept = default;
+        unique_ptr& operator=(unique_ptr&&) noexcept = default;
+
+        template <typename U,
+                  typename E,
+                  typename = typename std::enable_if<
+                      !std::is_array<U>::value &&
+                      std::is_convertible<U*, T*>::value &&
+                      std::is_convertible<E, Deleter>::value>::type>
+        unique_ptr(unique_ptr<U, E>&& p) noexcept
+            : base(p.release(), std::forward<E>(p.get_deleter()))
+        {
+        }
+
         EKUTIL_CONSTEXPR pointer operator->() const noexcept
         {
-            return m_ptr;
+            return this->get();
         }
         EKUTIL_CONSTEXPR typename std::add_lvalue_reference<T>::type operator*()
             const
         {
-            return *m_ptr;
+            return *this->get();
         }
-
-    private:
-        pointer m_ptr{nullptr};
     };
 
-    EKUTIL_CLANG_PUSH
-    EKUTIL_CLANG_IGNORE("-Wpadded")
+    /// Owning pointer to an array, deleting it with `Deleter`
+    template <typename T, typename Deleter>
+    class unique_ptr<T[], Deleter> : public unique_ptr_base<T, Deleter> {
+        using base = unique_ptr_base<T, Deleter>;
+
+        /// Only `pointer`, or a less qualified one: deleting an array of
+        /// derived objects through a pointer to the base is undefined
+        template <typename U>
+        using _enable_pointer = typename std::enable_if<
+            std::is_pointer<U>::value &&
+            std::is_convertible<typename std::remove_pointer<U>::type (*)[],
+                                T (*)[]>::value>::type;
 
-    template <typename T>
-    class erased_storage {
     public:
-        using value_type = T;
-        using pointer = T*;
-        using storage_type =
-            typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+        using pointer = typename base::pointer;
 
-        erased_storage() noexcept = default;
+        EKUTIL_CONSTEXPR unique_ptr() noexcept = default;
+        EKUTIL_CONSTEXPR unique_ptr(std::nullptr_t) noexcept {}
 
-        erased_storage(T val) noexcept(
-            std::is_nothrow_move_constructible<T>::value)
-            : m_ptr(::new (static_cast<void*>(&m_data)) T(std::move(val)))
+        template <typename U, typename = _enable_pointer<U>>
+        EKUTIL_CONSTEXPR explicit unique_ptr(U p) noexcept : base(p)
         {
         }
-
-        erased_storage(const erased_storage& other)
-            : m_ptr(::new (static_cast<void*>(&m_data)) T(other.get()))
+        template <typename U, typename = _enable_pointer<U>>
+        unique_ptr(U p, const Deleter& d) noexcept : base(p, d)
         {
         }
-        erased_storage& operator=(const erased_storage& other)
+        template <typename U, typename = _enable_pointer<U>>
+        unique_ptr(U p, Deleter&& d) noexcept : base(p, std::move(d))
         {
-            _destruct();
-            m_ptr = ::new (static_cast<void*>(&m_data)) T(other.get());
-            return *this;
         }
 
-        erased_storage(erased_storage&& other) noexcept
-            : m_ptr(::new (static_cast<void*>(&m_data))
-                        T(std::move(other.get())))
+        unique_ptr(unique_ptr&&) noexcept = default;
+        unique_ptr& operator=(unique_ptr&&) noexcept = default;
+
+        template <typename U, typename = _enable_pointer<U>>
+        void reset(U p) noexcept
         {
+            base::reset(p);
         }
-        erased_storage& operator=(erased_storage&& other) noexcept
+        void reset(std::nullptr_t = nullptr) noexcept
         {
-            _destruct();
-            m_ptr =
-                ::new (static_cast<void*>(&m_data)) T(std::move(other.get()));
-            return *this;
+            base::reset();
         }
 
-        ~erased_storage() noexcept
+        EKUTIL_CONSTEXPR T& operator[](size_t i) const
         {
-            _destruct();
+            return this->get()[i];
         }
+    };
 
-        EKUTIL_CONSTEXPR14 T& get() noexcept
+    template <typename T, typename D>
+    void swap(unique_ptr<T, D>& a, unique_ptr<T, D>& b) noexcept
+    {
+        a.swap(b);
+    }
+
+    template <typename T, typename D, typename U, typename E>
+    bool operator==(const unique_ptr<T, D>& a,
+                    const unique_ptr<U, E>& b) noexcept
+    {
+        return a.get() == b.get();
+    }
+    template <typename T, typename D, typename U, typename E>
+    bool operator!=(const unique_ptr<T, D>& a,
+                    const unique_ptr<U, E>& b) noexcept
+    {
+        return a.get() != b.get();
+    }
+    template <typename T, typename D>
+    bool operator==(const unique_ptr<T, D>& p, std::nullptr_t) noexcept
+    {
+        return !p;
+    }
+    template <typename T, typename D>
+    bool operator==(std::nullptr_t, const unique_ptr<T, D>& p) noexcept
+    {
+        return !p;
+    }
+    template <typename T, typename D>
+    bool operator!=(const unique_ptr<T, D>& p, std::nullptr_t) noexcept
+    {
+        return static_cast<bool>(p);
+    }
+    template <typename T, typename D>
+    bool operator!=(std::nullptr_t, const unique_ptr<T, D>& p) noexcept
+    {
+        return static_cast<bool>(p);
+    }
+
+    static_assert(sizeof(unique_ptr<int>) == sizeof(int*),
+                  "unique_ptr: default deleter takes up space");
+    static_assert(sizeof(unique_ptr<int[]>) == sizeof(int*),
+                  "unique_ptr: default deleter takes up space");
+
+    template <typename T, typename... Args>
+    typename std::enable_if<!std::is_array<T>::value, unique_ptr<T>>::type
+    make_unique(Args&&... args)
+    {
+        return unique_ptr<T>(new T(std::forward<Args>(args)...));
+    }
+    /// `n` value-initialized elements
+    template <typename T>
+    typename std::enable_if<std::is_array<T>::value &&
+                                std::extent<T>::value == 0,
+                            unique_ptr<T>>::type
+    make_unique(size_t n)
+    {
+        return unique_ptr<T>(new typename std::remove_extent<T>::type[n]());
+    }
+
+    /// Like `make_unique`, but default-initialized: trivial types are left
+    /// uninitialized
+    template <typename T>
+    typename std::enable_if<!std::is_array<T>::value, unique_ptr<T>>::type
+    make_unique_for_overwrite()
+    {
+        return unique_ptr<T>(new T);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_array<T>::value &&
+                                std::extent<T>::value == 0,
+                            unique_ptr<T>>::type
+    make_unique_for_overwrite(size_t n)
+    {
+        return unique_ptr<T>(new typename std::remove_extent<T>::type[n]);
+    }
+
+    EKUTIL_CLANG_PUSH
+    EKUTIL_CLANG_IGNORE("-Wpadded")
+
+    /**
+     * Bump allocator: allocation moves a pointer forward in the current
+     * block, deallocation does nothing, and `release()` frees everything at
+     * once.
+     * Allocation starts from the buffer given on construction (if any), and
+     * continues in heap blocks, each twice the size of the previous one, up
+     * to `max_block_size` (or larger, for large allocations).
+     *
+     * Not thread-safe. Use `arena_allocator` to allocate from this with
+     * standard containers or `small_vector`.
+     */
+    class monotonic_arena {
+    public:
+        static EKUTIL_CONSTEXPR_DECL const size_t default_block_size = 4096;
+        static EKUTIL_CONSTEXPR_DECL const size_t max_block_size = 1 << 20;
+
+        explicit monotonic_arena(
+            size_t block_size = default_block_size) noexcept
+            : monotonic_arena(nullptr, 0, block_size)
         {
-            return _get();
         }
-        EKUTIL_CONSTEXPR14 const T& get() const noexcept
+        /// Allocate from `buffer` first, which must outlive this
+        monotonic_arena(void* buffer,
+                        size_t size,
+                        size_t block_size = default_block_size) noexcept
+            : m_initial(static_cast<unsigned char*>(buffer)),
+              m_initial_size(size),
+              m_cur(m_initial),
+              m_end(m_initial + size),
+              m_first_block_size(block_size < sizeof(block_header) * 2
+                                     ? sizeof(block_header) * 2
+                                     : block_size),
+              m_next_block_size(m_first_block_size)
         {
-            return _get();
         }
 
-        EKUTIL_CONSTEXPR14 T& operator*() noexcept
-        {
-            return _get();
-        }
-        EKUTIL_CONSTEXPR14 const T& operator*() const noexcept
+        monotonic_arena(const monotonic_arena&) = delete;
+        monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+        ~monotonic_arena() noexcept
         {
-            return _get();
+            release();
         }
 
-        EKUTIL_CONSTEXPR14 T* operator->() noexcept
+        void* allocate(size_t bytes,
+                       size_t alignment = alignof(std::max_align_t))
         {
-            return std::addressof(_get());
+            void* p = m_cur;
+            auto space = static_cast<size_t>(m_end - m_cur);
+            if (EKUTIL_LIKELY(std::align(alignment, bytes, p, space))) {
+                m_cur = static_cast<unsigned char*>(p) + bytes;
+                return p;
+            }
+            return _allocate_block(bytes, alignment);
         }
-        EKUTIL_CONSTEXPR14 const T* operator->() const noexcept
+        /// Only reclaims the memory if `p` was the last allocation
+        void deallocate(void* p, size_t bytes, size_t alignment = 0) noexcept
         {
-            return std::addressof(_get());
+            EKUTIL_UNUSED(alignment);
+            if (static_cast<unsigned char*>(p) + bytes == m_cur) {
+                m_cur = static_cast<unsigned char*>(p);
+            }
         }
 
-    private:
-        void _destruct()
+        /// Free all heap blocks, and start over from the initial buffer.
+        /// Everything allocated from this is invalidated.
+        void release() noexcept
         {
-            if (m_ptr) {
-                _get().~T();
+            while (m_blocks) {
+                auto prev = m_blocks->prev;
+                ::operator delete(static_cast<void*>(m_blocks));
+                m_blocks = prev;
             }
+            m_cur = m_initial;
+            m_end = m_initial + m_initial_size;
+            m_next_block_size = m_first_block_size;
         }
-        static pointer _toptr(storage_type& data)
+
+    private:
+        struct block_header {
+            block_header* prev;
+            size_t size;
+        };
+
+        void* _allocate_block(size_t bytes, size_t alignment)
         {
-#if EKUTIL_HAS_LAUNDER
-            return std::launder<T>(reinterpret_cast<T*>(std::addressof(data)));
+            auto overhead = sizeof(block_header) + alignment;
+            if (bytes > std::numeric_limits<size_t>::max() - overhead) {
+                throw std::bad_alloc{};
+            }
+            auto size = m_next_block_size;
+            if (bytes + overhead > size) {
+                size = bytes + overhead;
+            }
+
+            auto mem = static_cast<unsigned char*>(::operator new(size));
+            m_blocks = ::new (static_cast<void*>(mem))
+                block_header{m_blocks, size};
+            m_cur = mem + sizeof(block_header);
+            m_end = mem + size;
+            if (m_next_block_size < max_block_size) {
+                m_next_block_size *= 2;
+            }
+
+            void* p = m_cur;
+            auto space = static_cast<size_t>(m_end - m_cur);
+            std::align(alignment, bytes, p, space);
+            m_cur = static_cast<unsigned char*>(p) + bytes;
+            return p;
+        }
+
+        unsigned char* m_initial;
+        size_t m_initial_size;
+        unsigned char* m_cur;
+        unsigned char* m_end;
+        size_t m_first_block_size;
+        size_t m_next_block_size;
+        block_header* m_blocks{nullptr};
+    };
+
+    /// A `monotonic_arena` starting with a buffer of `N` bytes inside it
+    template <size_t N>
+    class inline_monotonic_arena : public monotonic_arena {
+    public:
+        explicit inline_monotonic_arena(
+            size_t block_size = default_block_size) noexcept
+            : monotonic_arena(m_buffer, N, block_size)
+        {
+        }
+
+    private:
+        alignas(std::max_align_t) unsigned char m_buffer[N];
+    };
+
+    /**
+     * Standard allocator allocating from a `monotonic_arena`, which must
+     * outlive every container using it.
+     * Copies allocate from the same arena; allocators are equal if they
+     * use the same arena.
+     */
+    template <typename T>
+    class arena_allocator {
+    public:
+        using value_type = T;
+
+        arena_allocator(monotonic_arena& arena) noexcept : m_arena(&arena) {}
+        template <typename U>
+        arena_allocator(const arena_allocator<U>& other) noexcept
+            : m_arena(&other.arena())
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+                throw std::bad_alloc{};
+            }
+            return static_cast<T*>(
+                m_arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T* p, size_t n) noexcept
+        {
+            m_arena->deallocate(p, n * sizeof(T), alignof(T));
+        }
+
+        monotonic_arena& arena() const noexcept
+        {
+            return *m_arena;
+        }
+
+    private:
+        monotonic_arena* m_arena;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const arena_allocator<T>& a,
+                    const arena_allocator<U>& b) noexcept
+    {
+        return &a.arena() == &b.arena();
+    }
+    template <typename T, typename U>
+    bool operator!=(const arena_allocator<T>& a,
+                    const arena_allocator<U>& b) noexcept
+    {
+        return !(a == b);
+    }
+
+#if EKUTIL_HAS_MMAP
+    inline size_t _page_size() noexcept
+    {
+        static const auto size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+    inline size_t _round_to_pages(size_t bytes) noexcept
+    {
+        return (bytes + _page_size() - 1) & ~(_page_size() - 1);
+    }
+
+    /// Ask for `[p, p + bytes)` to be backed by transparent huge pages.
+    /// Only a hint: not all systems have them, or have them enabled.
+    inline void _advise_huge_pages(void* p, size_t bytes) noexcept
+    {
+#ifdef MADV_HUGEPAGE
+        ::madvise(p, bytes, MADV_HUGEPAGE);
+#else
+        EKUTIL_UNUSED(p);
+        EKUTIL_UNUSED(bytes);
+#endif
+    }
+
+    /// Map `bytes` (a multiple of the page size) of private memory
+    inline void* _map_pages(size_t bytes)
+    {
+        auto p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc{};
+        }
+        _advise_huge_pages(p, bytes);
+        return p;
+    }
+#endif
+
+    /// Whether `Allocator` tells how many bytes an allocation really gets,
+    /// with `good_size(bytes)`, like `slab_allocator`
+    template <typename Allocator, typename = void>
+    struct has_good_size : std::false_type {
+    };
+    template <typename Allocator>
+    struct has_good_size<Allocator,
+                         void_t<decltype(std::declval<const Allocator&>()
+                                             .good_size(size_t{}))>>
+        : std::true_type {
+    };
+
+    template <typename Allocator>
+    size_t _good_size(const Allocator& alloc,
+                      size_t bytes,
+                      std::true_type) noexcept
+    {
+        return alloc.good_size(bytes);
+    }
+    template <typename Allocator>
+    size_t _good_size(const Allocator&, size_t bytes, std::false_type) noexcept
+    {
+        return bytes;
+    }
+
+    /**
+     * The number of bytes an allocation of `bytes` from `alloc` really
+     * gets, which a container may use without asking for more:
+     * `alloc.good_size(bytes)`, or `bytes` if the allocator doesn't say.
+     */
+    template <typename Allocator>
+    size_t allocator_good_size(const Allocator& alloc, size_t bytes) noexcept
+    {
+        return _good_size(alloc, bytes, has_good_size<Allocator>{});
+    }
+
+    /// Default size from which `large_buffer_allocator` maps memory
+    /// directly: one x86-64 huge page
+    EKUTIL_CONSTEXPR_DECL const size_t large_buffer_threshold = 2 << 20;
+
+    /**
+     * Standard allocator for buffers that may grow very large.
+     * Buffers of at least `Threshold` bytes are mapped directly from the
+     * system with `mmap`, hinting that they be backed by transparent huge
+     * pages; smaller ones come from `Fallback`. Where `mmap` isn't
+     * available, everything comes from `Fallback`.
+     *
+     * Mapped buffers can be resized with `try_reallocate`, which
+     * `small_vector` uses when growing or shrinking trivially relocatable
+     * elements: with `mremap` (Linux only), the pages are kept, and either
+     * the mapping is extended in place, or the page tables are moved,
+     * instead of copying the elements.
+     */
+    template <typename T,
+              size_t Threshold = large_buffer_threshold,
+              typename Fallback = std::allocator<T>>
+    class large_buffer_allocator : private ebo_storage<Fallback> {
+        using fallback_traits = std::allocator_traits<Fallback>;
+        using fallback_base = ebo_storage<Fallback>;
+
+        static_assert(Threshold > 0,
+                      "large_buffer_allocator: Threshold must be nonzero");
+
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using propagate_on_container_copy_assignment =
+            typename fallback_traits::propagate_on_container_copy_assignment;
+        using propagate_on_container_move_assignment =
+            typename fallback_traits::propagate_on_container_move_assignment;
+        using propagate_on_container_swap =
+            typename fallback_traits::propagate_on_container_swap;
+
+        template <typename U>
+        struct rebind {
+            using other = large_buffer_allocator<
+                U,
+                Threshold,
+                typename fallback_traits::template rebind_alloc<U>>;
+        };
+
+        large_buffer_allocator() = default;
+        explicit large_buffer_allocator(const Fallback& fallback)
+            : fallback_base(fallback)
+        {
+        }
+        template <typename U, typename F>
+        large_buffer_allocator(
+            const large_buffer_allocator<U, Threshold, F>& other)
+            : fallback_base(Fallback(other.fallback()))
+        {
+        }
+
+        /// Whether buffers of `n` elements are mapped directly
+        static bool is_large(size_type n) noexcept
+        {
+#if EKUTIL_HAS_MMAP
+            return n > (Threshold - 1) / sizeof(T);
+#else
+            EKUTIL_UNUSED(n);
+            return false;
+#endif
+        }
+        static size_type max_size() noexcept
+        {
+            return std::numeric_limits<size_t>::max() / 2 / sizeof(T);
+        }
+
+        /// Mapped buffers get whole pages, others what `Fallback` says
+        size_t good_size(size_t bytes) const noexcept
+        {
+#if EKUTIL_HAS_MMAP
+            if (is_large(bytes / sizeof(T))) {
+                return _round_to_pages(bytes);
+            }
+#endif
+            return allocator_good_size(fallback(), bytes);
+        }
+
+        T* allocate(size_type n)
+        {
+#if EKUTIL_HAS_MMAP
+            if (is_large(n)) {
+                if (n > max_size()) {
+                    throw std::bad_alloc{};
+                }
+                return static_cast<T*>(_map_pages(_bytes(n)));
+            }
+#endif
+            return fallback_traits::allocate(fallback(), n);
+        }
+        void deallocate(T* p, size_type n) noexcept
+        {
+#if EKUTIL_HAS_MMAP
+            if (is_large(n)) {
+                ::munmap(p, _bytes(n));
+                return;
+            }
+#endif
+            fallback_traits::deallocate(fallback(), p, n);
+        }
+
+        /**
+         * Resize the buffer `p` of `n` elements to `new_n`, keeping its
+         * contents as bytes, if both sizes are large. Returns the new
+         * address, or `nullptr` (leaving `p` untouched) when that's not
+         * possible, and the buffer has to be copied.
+         * Only for trivially relocatable `T`.
+         */
+        T* try_reallocate(T* p, size_type n, size_type new_n) noexcept
+        {
+#if EKUTIL_HAS_MMAP
+            if (!is_large(n) || !is_large(new_n) || new_n > max_size()) {
+                return nullptr;
+            }
+            auto bytes = _bytes(n), new_bytes = _bytes(new_n);
+            if (new_bytes <= bytes) {
+                if (new_bytes != bytes) {
+                    ::munmap(reinterpret_cast<char*>(p) + new_bytes,
+                             bytes - new_bytes);
+                }
+                return p;
+            }
+#if EKUTIL_HAS_MREMAP
+            auto q = ::mremap(p, bytes, new_bytes, MREMAP_MAYMOVE);
+            if (q == MAP_FAILED) {
+                return nullptr;
+            }
+            _advise_huge_pages(q, new_bytes);
+            return static_cast<T*>(q);
+#else
+            return nullptr;
+#endif
+#else
+            EKUTIL_UNUSED(p);
+            EKUTIL_UNUSED(n);
+            EKUTIL_UNUSED(new_n);
+            return nullptr;
+#endif
+        }
+
+        /**
+         * Give the memory of the whole pages of `p` (a buffer of `n`
+         * elements) past its first `used` elements back to the system with
+         * `madvise(MADV_DONTNEED)`, keeping the buffer: e.g. after clearing
+         * a large vector that will be filled again. The contents of those
+         * elements are lost. Does nothing for buffers that aren't mapped.
+         */
+        void release_unused(T* p, size_type used, size_type n) noexcept
+        {
+#if EKUTIL_HAS_MMAP
+            if (!is_large(n)) {
+                return;
+            }
+            auto first = _round_to_pages(used * sizeof(T));
+            auto last = _bytes(n);
+            if (first < last) {
+                ::madvise(reinterpret_cast<char*>(p) + first, last - first,
+                          MADV_DONTNEED);
+            }
+#else
+            EKUTIL_UNUSED(p);
+            EKUTIL_UNUSED(used);
+            EKUTIL_UNUSED(n);
+#endif
+        }
+
+        const Fallback& fallback() const noexcept
+        {
+            return fallback_base::get_value();
+        }
+        Fallback& fallback() noexcept
+        {
+            return fallback_base::get_value();
+        }
+
+    private:
+#if EKUTIL_HAS_MMAP
+        static size_t _bytes(size_type n) noexcept
+        {
+            return _round_to_pages(n * sizeof(T));
+        }
+#endif
+    };
+
+    template <typename T, typename U, size_t Threshold, typename F, typename G>
+    bool operator==(const large_buffer_allocator<T, Threshold, F>& a,
+                    const large_buffer_allocator<U, Threshold, G>& b) noexcept
+    {
+        return a.fallback() == b.fallback();
+    }
+    template <typename T, typename U, size_t Threshold, typename F, typename G>
+    bool operator!=(const large_buffer_allocator<T, Threshold, F>& a,
+                    const large_buffer_allocator<U, Threshold, G>& b) noexcept
+    {
+        return !(a == b);
+    }
+
+    /// Whether `Allocator` can resize buffers with `try_reallocate`, like
+    /// `large_buffer_allocator`
+    template <typename Allocator, typename = void>
+    struct has_try_reallocate : std::false_type {
+    };
+    template <typename Allocator>
+    struct has_try_reallocate<
+        Allocator,
+        void_t<decltype(std::declval<Allocator&>().try_reallocate(
+            std::declval<typename Allocator::value_type*>(),
+            size_t{},
+            size_t{}))>> : std::true_type {
+    };
+
+    /**
+     * The caches of the calling thread for the pools of one type, one per
+     * pool. A `Cache` is constructed from, and refers to its pool through,
+     * `std::shared_ptr<Owner> owner`: the state the pool shares with the
+     * caches, which outlives the pool as long as a cache refers to it.
+     * A cache is dropped when its pool is destroyed on this thread, when
+     * this thread exits, or when this thread next creates a cache and finds
+     * its pool gone.
+     */
+    template <typename Cache, typename Owner>
+    class thread_cache_registry {
+    public:
+        /// Set when the caches of this thread are gone: pools with static
+        /// storage duration outlive them on the main thread
+        static bool exited() noexcept
+        {
+            return _exited();
+        }
+
+        /// The cache of this thread for `owner`, if it has one. Doesn't
+        /// allocate.
+        static Cache* find(const std::shared_ptr<Owner>& owner) noexcept
+        {
+            auto& caches = _caches();
+            if (EKUTIL_LIKELY(!caches.empty() &&
+                              caches.back().owner == owner)) {
+                return &caches.back();
+            }
+            for (auto& c : caches) {
+                if (c.owner == owner) {
+                    // Most recently used last
+                    std::swap(c, caches.back());
+                    return &caches.back();
+                }
+            }
+            return nullptr;
+        }
+        /// The cache of this thread for `owner`, created if needed
+        static Cache& get(const std::shared_ptr<Owner>& owner)
+        {
+            if (auto c = find(owner)) {
+                return *c;
+            }
+
+            // Drop the caches of dead pools, only referenced from here
+            auto& caches = _caches();
+            caches.erase(std::remove_if(caches.begin(), caches.end(),
+                                        [](const Cache& c) {
+                                            return c.owner.use_count() == 1;
+                                        }),
+                         caches.end());
+            caches.emplace_back(owner);
+            return caches.back();
+        }
+        /// Drop the cache of this thread for `owner`, if any
+        static void erase(const std::shared_ptr<Owner>& owner) noexcept
+        {
+            if (_exited()) {
+                return;
+            }
+            auto& caches = _caches();
+            for (auto it = caches.begin(); it != caches.end(); ++it) {
+                if (it->owner == owner) {
+                    caches.erase(it);
+                    return;
+                }
+            }
+        }
+
+    private:
+        struct thread_caches {
+            ~thread_caches()
+            {
+                caches.clear();
+                _exited() = true;
+            }
+
+            std::vector<Cache> caches;
+        };
+
+        static std::vector<Cache>& _caches()
+        {
+            static thread_local thread_caches c;
+            return c.caches;
+        }
+        static bool& _exited() noexcept
+        {
+            static thread_local bool exited = false;
+            return exited;
+        }
+    };
+
+    /// Deleter returning objects to the `object_pool` they came from
+    template <typename Pool>
+    class pool_deleter {
+    public:
+        pool_deleter() noexcept = default;
+        explicit pool_deleter(Pool& pool) noexcept : m_pool(&pool) {}
+
+        void operator()(typename Pool::value_type* p) const noexcept
+        {
+            m_pool->destroy(p);
+        }
+
+    private:
+        Pool* m_pool{nullptr};
+    };
+
+    /**
+     * Pool of fixed-size slots for `T` objects.
+     *
+     * Every thread allocates from, and frees to, its own magazines (lists
+     * of up to `MagazineSize` free slots) without locking. Full magazines
+     * are exchanged with a shared depot, under a lock, in one operation.
+     * When the depot runs dry, it carves a new chunk of `chunk_size`
+     * slots; memory is only given back to the system when the pool, and
+     * the magazines of every thread that used it, are gone.
+     *
+     * Every object must be returned to the pool before the pool is
+     * destroyed.
+     */
+    template <typename T, size_t MagazineSize = 32>
+    class object_pool {
+        static_assert(MagazineSize > 0, "object_pool: empty magazines");
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "object_pool: over-aligned types are not supported");
+
+        /// A free slot links to the next one in its magazine, the first
+        /// slot of a magazine in the depot to the next magazine
+        union slot {
+            struct {
+                slot* next;
+                slot* next_magazine;
+            } link;
+            basic_stack_storage_type<T> storage;
+        };
+
+        struct magazine {
+            slot* head{nullptr};
+            size_t size{0};
+
+            void push(slot* s) noexcept
+            {
+                s->link.next = head;
+                head = s;
+                ++size;
+            }
+            slot* pop() noexcept
+            {
+                auto s = head;
+                head = s->link.next;
+                --size;
+                return s;
+            }
+        };
+
+        struct depot {
+            explicit depot(size_t chunk) : chunk_size(chunk) {}
+
+            /// A full magazine, or whatever is left
+            magazine get()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                magazine m;
+                if (full) {
+                    m.head = full;
+                    m.size = MagazineSize;
+                    full = full->link.next_magazine;
+                }
+                else if (loose.size != 0) {
+                    m = loose;
+                    loose = magazine{};
+                }
+                else {
+                    if (chunk_used == chunk_size) {
+                        chunks.emplace_back(new slot[chunk_size]);
+                        chunk_used = 0;
+                    }
+                    auto chunk = chunks.back().get();
+                    for (; m.size != MagazineSize && chunk_used != chunk_size;
+                         ++chunk_used) {
+                        m.push(chunk + chunk_used);
+                    }
+                }
+                return m;
+            }
+            void put_full(magazine m) noexcept
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                m.head->link.next_magazine = full;
+                full = m.head;
+            }
+            void put(magazine m) noexcept
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (m.size != 0) {
+                    loose.push(m.pop());
+                    if (loose.size == MagazineSize) {
+                        loose.head->link.next_magazine = full;
+                        full = loose.head;
+                        loose = magazine{};
+                    }
+                }
+            }
+            size_t capacity()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return chunks.empty()
+                           ? 0
+                           : (chunks.size() - 1) * chunk_size + chunk_used;
+            }
+
+            std::mutex mutex;
+            slot* full{nullptr};
+            magazine loose;
+            std::vector<std::unique_ptr<slot[]>> chunks;
+            size_t chunk_size;
+            size_t chunk_used{chunk_size};
+        };
+
+        /// The magazines of one thread for one pool: `loaded` is used
+        /// first, `previous` is either full or empty
+        struct thread_cache {
+            explicit thread_cache(std::shared_ptr<depot> d)
+                : owner(std::move(d))
+            {
+            }
+            thread_cache(thread_cache&& other) noexcept
+                : owner(std::move(other.owner)),
+                  loaded(other.loaded),
+                  previous(other.previous)
+            {
+                other.loaded = magazine{};
+                other.previous = magazine{};
+            }
+            thread_cache& operator=(thread_cache&& other) noexcept
+            {
+                flush();
+                owner = std::move(other.owner);
+                loaded = other.loaded;
+                previous = other.previous;
+                other.loaded = magazine{};
+                other.previous = magazine{};
+                return *this;
+            }
+            ~thread_cache()
+            {
+                flush();
+            }
+
+            slot* allocate()
+            {
+                if (loaded.size == 0) {
+                    if (previous.size != 0) {
+                        std::swap(loaded, previous);
+                    }
+                    else {
+                        loaded = owner->get();
+                    }
+                }
+                return loaded.pop();
+            }
+            void deallocate(slot* s) noexcept
+            {
+                if (loaded.size == MagazineSize) {
+                    if (previous.size != 0) {
+                        owner->put_full(previous);
+                    }
+                    previous = loaded;
+                    loaded = magazine{};
+                }
+                loaded.push(s);
+            }
+            void flush() noexcept
+            {
+                if (!owner) {
+                    return;
+                }
+                owner->put(loaded);
+                owner->put(previous);
+                loaded = magazine{};
+                previous = magazine{};
+            }
+
+            std::shared_ptr<depot> owner;
+            magazine loaded;
+            magazine previous;
+        };
+
+    public:
+        using value_type = T;
+        using deleter_type = pool_deleter<object_pool>;
+        using unique_ptr_type = unique_ptr<T, deleter_type>;
+
+        explicit object_pool(size_t chunk_size = 8 * MagazineSize)
+            : m_depot(std::make_shared<depot>(
+                  chunk_size < MagazineSize ? MagazineSize : chunk_size))
+        {
+        }
+
+        object_pool(const object_pool&) = delete;
+        object_pool& operator=(const object_pool&) = delete;
+
+        /// The magazines of other threads are returned when they exit, or
+        /// when they next use a new pool of this type
+        ~object_pool()
+        {
+            caches::erase(m_depot);
+        }
+
+        /// Uninitialized storage for a `T`
+        void* allocate()
+        {
+            if (EKUTIL_UNLIKELY(caches::exited())) {
+                auto m = m_depot->get();
+                auto s = m.pop();
+                m_depot->put(m);
+                return s;
+            }
+            return caches::get(m_depot).allocate();
+        }
+        /// From any thread: one that has no cache for this pool yet (e.g.
+        /// that never allocated from it) hands the slot to the depot
+        /// rather than allocating a cache
+        void deallocate(void* p) noexcept
+        {
+            auto local = caches::exited() ? nullptr : caches::find(m_depot);
+            if (EKUTIL_LIKELY(local != nullptr)) {
+                local->deallocate(static_cast<slot*>(p));
+                return;
+            }
+            magazine m;
+            m.push(static_cast<slot*>(p));
+            m_depot->put(m);
+        }
+
+        template <typename... Args>
+        T* create(Args&&... args)
+        {
+            auto p = allocate();
+            try {
+                return ::new (p) T(std::forward<Args>(args)...);
+            }
+            catch (...) {
+                deallocate(p);
+                throw;
+            }
+        }
+        void destroy(T* p) noexcept
+        {
+            p->~T();
+            deallocate(p);
+        }
+
+        template <typename... Args>
+        unique_ptr_type make_unique(Args&&... args)
+        {
+            return unique_ptr_type(create(std::forward<Args>(args)...),
+                                   deleter_type(*this));
+        }
+
+        /// Number of slots carved out of chunks so far
+        size_t capacity() const
+        {
+            return m_depot->capacity();
+        }
+
+    private:
+        using caches = thread_cache_registry<thread_cache, depot>;
+
+        std::shared_ptr<depot> m_depot;
+    };
+
+    template <typename T, bool = niche_traits<T>::has_niche>
+    class compact_optional_storage;
+
+    /// The empty state is the niche of `T`: no flag
+    template <typename T>
+    class compact_optional_storage<T, true> {
+        using traits = niche_traits<T>;
+
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "compact_optional: a type with a niche must be "
+                      "trivially copyable");
+
+    public:
+        compact_optional_storage() noexcept : m_value(traits::empty_value())
+        {
+        }
+
+        bool has_value() const noexcept
+        {
+            return !traits::is_empty_value(m_value);
+        }
+
+    protected:
+        T* _ptr() noexcept
+        {
+            return std::addressof(m_value);
+        }
+        const T* _ptr() const noexcept
+        {
+            return std::addressof(m_value);
+        }
+
+        template <typename... Args>
+        void _construct(Args&&... args)
+        {
+            ::new (static_cast<void*>(std::addressof(m_value)))
+                T(std::forward<Args>(args)...);
+        }
+        void _destroy() noexcept
+        {
+            m_value = traits::empty_value();
+        }
+
+    private:
+        T m_value;
+    };
+
+    /// The empty state is a flag after the value
+    template <typename T>
+    class compact_optional_storage<T, false> {
+    public:
+        compact_optional_storage() noexcept = default;
+
+        bool has_value() const noexcept
+        {
+            return m_engaged;
+        }
+
+    protected:
+        T* _ptr() noexcept
+        {
+            return _launder(reinterpret_cast<T*>(std::addressof(m_data)));
+        }
+        const T* _ptr() const noexcept
+        {
+            return _launder(
+                reinterpret_cast<const T*>(std::addressof(m_data)));
+        }
+
+        template <typename... Args>
+        void _construct(Args&&... args)
+        {
+            ::new (static_cast<void*>(std::addressof(m_data)))
+                T(std::forward<Args>(args)...);
+            m_engaged = true;
+        }
+        void _destroy() noexcept
+        {
+            _ptr()->~T();
+            m_engaged = false;
+        }
+
+    private:
+        template <typename U>
+        static U* _launder(U* p) noexcept
+        {
+#if EKUTIL_HAS_LAUNDER
+            return std::launder(p);
+#else
+            return p;
+#endif
+        }
+
+        basic_stack_storage_type<T> m_data;
+        bool m_engaged{false};
+    };
+
+    /**
+     * A `T` stored in place, or nothing.
+     * If `niche_traits<T>` gives `T` a spare bit pattern, like for
+     * pointers, `span` and `string_view`, the empty state is marked with it,
+     * and `sizeof(compact_optional<T>) == sizeof(T)`. Otherwise, a `bool`
+     * follows the value.
+     * Access is unchecked.
+     */
+    template <typename T>
+    class compact_optional : public compact_optional_storage<T> {
+        using base = compact_optional_storage<T>;
+
+    public:
+        using value_type = T;
+
+        compact_optional() noexcept = default;
+
+        compact_optional(const T& val)
+        {
+            this->_construct(val);
+        }
+        compact_optional(T&& val)
+        {
+            this->_construct(std::move(val));
+        }
+
+        compact_optional(const compact_optional& other) : base()
+        {
+            if (other.has_value()) {
+                this->_construct(*other);
+            }
+        }
+        compact_optional(compact_optional&& other) noexcept(
+            std::is_nothrow_move_constructible<T>::value)
+            : base()
+        {
+            if (other.has_value()) {
+                this->_construct(std::move(*other));
+            }
+        }
+
+        compact_optional& operator=(const compact_optional& other)
+        {
+            if (other.has_value()) {
+                _assign(*other);
+            }
+            else {
+                reset();
+            }
+            return *this;
+        }
+        compact_optional& operator=(compact_optional&& other) noexcept(
+            std::is_nothrow_move_constructible<T>::value &&
+            std::is_nothrow_move_assignable<T>::value)
+        {
+            if (other.has_value()) {
+                _assign(std::move(*other));
+            }
+            else {
+                reset();
+            }
+            return *this;
+        }
+
+        ~compact_optional()
+        {
+            if (!std::is_trivially_destructible<T>::value) {
+                reset();
+            }
+        }
+
+        template <typename... Args>
+        T& emplace(Args&&... args)
+        {
+            reset();
+            this->_construct(std::forward<Args>(args)...);
+            return **this;
+        }
+        void reset() noexcept
+        {
+            if (this->has_value()) {
+                this->_destroy();
+            }
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return this->has_value();
+        }
+
+        T& get() noexcept
+        {
+            return *this->_ptr();
+        }
+        const T& get() const noexcept
+        {
+            return *this->_ptr();
+        }
+
+        T& operator*() noexcept
+        {
+            return get();
+        }
+        const T& operator*() const noexcept
+        {
+            return get();
+        }
+
+        T* operator->() noexcept
+        {
+            return this->_ptr();
+        }
+        const T* operator->() const noexcept
+        {
+            return this->_ptr();
+        }
+
+    private:
+        template <typename U>
+        void _assign(U&& val)
+        {
+            if (this->has_value()) {
+                get() = std::forward<U>(val);
+            }
+            else {
+                this->_construct(std::forward<U>(val));
+            }
+        }
+    };
+
+    /**
+     * A `T` stored in place, constructed later or not at all.
+     * Built on `compact_optional`, without a pointer to the value: access
+     * is unchecked, and reads the value in place.
+     */
+    template <typename T>
+    class erased_storage {
+    public:
+        using value_type = T;
+        using pointer = T*;
+        using storage_type = compact_optional<T>;
+
+        erased_storage() noexcept = default;
+
+        erased_storage(T val) noexcept(
+            std::is_nothrow_move_constructible<T>::value)
+            : m_value(std::move(val))
+        {
+        }
+
+        bool has_value() const noexcept
+        {
+            return m_value.has_value();
+        }
+
+        EKUTIL_CONSTEXPR14 T& get() noexcept
+        {
+            return *m_value;
+        }
+        EKUTIL_CONSTEXPR14 const T& get() const noexcept
+        {
+            return *m_value;
+        }
+
+        EKUTIL_CONSTEXPR14 T& operator*() noexcept
+        {
+            return get();
+        }
+        EKUTIL_CONSTEXPR14 const T& operator*() const noexcept
+        {
+            return get();
+        }
+
+        EKUTIL_CONSTEXPR14 T* operator->() noexcept
+        {
+            return std::addressof(get());
+        }
+        EKUTIL_CONSTEXPR14 const T* operator->() const noexcept
+        {
+            return std::addressof(get());
+        }
+
+    private:
+        storage_type m_value;
+    };
+
+    /// Small number identifying the calling thread, assigned in the order
+    /// threads first call this
+    inline size_t thread_ordinal() noexcept
+    {
+        static std::atomic<size_t> next{0};
+        static thread_local size_t ordinal =
+            next.fetch_add(1, std::memory_order_relaxed);
+        return ordinal;
+    }
+
+    /**
+     * `N` counters, sharded so that threads incrementing them don't write
+     * to the same cache line. Every shard holds all `N` counters on a
+     * cache line of its own; a thread always adds to the same shard.
+     * Reading sums over all shards, so a read is not a snapshot of
+     * concurrent additions, and is `O(shard_count())`: meant for counters
+     * written often and read rarely.
+     */
+    template <size_t N>
+    class distributed_counter_array {
+        struct counters {
+            std::atomic<uint64_t> values[N];
+        };
+        using shard = cacheline_padded<counters>;
+
+    public:
+        /// The number of hardware threads, rounded up to a power of two
+        static size_t default_shard_count() noexcept
+        {
+            auto n = std::thread::hardware_concurrency();
+            return static_cast<size_t>(
+                next_pow2(static_cast<uint64_t>(n == 0 ? 1 : n)));
+        }
+
+        /// `shards` is rounded up to a power of two
+        explicit distributed_counter_array(
+            size_t shards = default_shard_count())
+            : m_mask(static_cast<size_t>(next_pow2(
+                         static_cast<uint64_t>(shards == 0 ? 1 : shards))) -
+                     1)
+        {
+            // Over-allocate to align by hand: `new shard[]` only respects
+            // the alignment since C++17
+            auto bytes = shard_count() * sizeof(shard);
+            auto space = bytes + alignof(shard) - 1;
+            m_buffer = make_unique_for_overwrite<unsigned char[]>(space);
+            void* p = m_buffer.get();
+            p = std::align(alignof(shard), bytes, p, space);
+            m_shards = static_cast<shard*>(p);
+            for (size_t i = 0; i < shard_count(); ++i) {
+                auto s = ::new (static_cast<void*>(m_shards + i)) shard;
+                for (auto& v : s->value.values) {
+                    v.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        distributed_counter_array(const distributed_counter_array&) = delete;
+        distributed_counter_array& operator=(
+            const distributed_counter_array&) = delete;
+
+        static EKUTIL_CONSTEXPR size_t size() noexcept
+        {
+            return N;
+        }
+        size_t shard_count() const noexcept
+        {
+            return m_mask + 1;
+        }
+
+        /// Add `n` to counter `i`
+        void add(size_t i, uint64_t n = 1) noexcept
+        {
+            m_shards[thread_ordinal() & m_mask].value.values[i].fetch_add(
+                n, std::memory_order_relaxed);
+        }
+        /// Sum of counter `i` over all shards
+        uint64_t load(size_t i) const noexcept
+        {
+            uint64_t sum = 0;
+            for (size_t s = 0; s < shard_count(); ++s) {
+                sum += m_shards[s].value.values[i].load(
+                    std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+        /// Zero every counter. Additions racing with this may be lost.
+        void reset() noexcept
+        {
+            for (size_t s = 0; s < shard_count(); ++s) {
+                for (auto& v : m_shards[s].value.values) {
+                    v.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        static_assert(std::is_trivially_destructible<shard>::value,
+                      "distributed_counter_array: shards aren't destroyed");
+
+        unique_ptr<unsigned char[]> m_buffer;
+        shard* m_shards{nullptr};
+        size_t m_mask;
+    };
+
+    /// One `distributed_counter_array` counter
+    class distributed_counter : private distributed_counter_array<1> {
+        using base = distributed_counter_array<1>;
+
+    public:
+        using base::base;
+        using base::default_shard_count;
+        using base::shard_count;
+
+        void add(uint64_t n = 1) noexcept
+        {
+            base::add(0, n);
+        }
+        uint64_t load() const noexcept
+        {
+            return base::load(0);
+        }
+        void reset() noexcept
+        {
+            base::reset();
+        }
+    };
+
+    /**
+     * Size classes of `slab_pool`: 8 bytes to 4 KiB, a power of two and
+     * one and a half times it per doubling (8, 16, 24, 32, 48, 64, 96, ...)
+     */
+    struct slab_size_classes {
+        static EKUTIL_CONSTEXPR_DECL const size_t count = 18;
+        static EKUTIL_CONSTEXPR_DECL const size_t max_size = 4096;
+
+        static size_t size(size_t index) noexcept
+        {
+            return index < 2 ? 8 << index
+                             : (index % 2 == 0 ? 3 : 4)
+                                   << (index / 2 + 2);
+        }
+
+        /// The smallest class fitting `bytes` aligned to `align`, or
+        /// `count` if there's none
+        static size_t index(size_t bytes, size_t align) noexcept
+        {
+            if (bytes > max_size) {
+                return count;
+            }
+            auto i = static_cast<size_t>(_table().index[(bytes + 7) / 8]);
+            if (EKUTIL_UNLIKELY(align > 8)) {
+                while (i != count && size(i) % align != 0) {
+                    ++i;
+                }
+            }
+            return i;
+        }
+
+    private:
+        struct table {
+            table() noexcept
+            {
+                size_t i = 0;
+                for (size_t n = 0; n <= max_size / 8; ++n) {
+                    while (size(i) < n * 8) {
+                        ++i;
+                    }
+                    index[n] = static_cast<unsigned char>(i);
+                }
+            }
+
+            unsigned char index[max_size / 8 + 1];
+        };
+        static const table& _table() noexcept
+        {
+            static const table t;
+            return t;
+        }
+    };
+
+    /// Counters of a `slab_pool`, read with `slab_pool::stats`
+    struct slab_pool_stats {
+        /// Bytes handed out and not yet returned, as requested
+        uint64_t bytes_requested;
+        /// The same, rounded up to the size classes
+        uint64_t bytes_in_use;
+        /// Bytes taken from the system: slabs, and large allocations
+        uint64_t bytes_reserved;
+        /// Allocations, large ones included
+        uint64_t allocations;
+        /// Allocations served from the free blocks of a thread, without
+        /// touching a fresh slab or the shared state
+        uint64_t cache_hits;
+        /// Allocations too large for the size classes, passed to `new`
+        uint64_t large_allocations;
+        /// Blocks freed by a thread other than the one that allocated them
+        uint64_t remote_frees;
+
+        /// The share of reserved memory not used by requested bytes:
+        /// rounding to size classes, free blocks and slab headers
+        double fragmentation() const noexcept
+        {
+            return bytes_reserved == 0
+                       ? 0.0
+                       : 1.0 - static_cast<double>(bytes_requested) /
+                                   static_cast<double>(bytes_reserved);
+        }
+        double hit_rate() const noexcept
+        {
+            return allocations == 0 ? 0.0
+                                    : static_cast<double>(cache_hits) /
+                                          static_cast<double>(allocations);
+        }
+    };
+
+    /**
+     * General purpose allocator for small blocks, for many threads.
+     * Blocks of up to 4 KiB are rounded up to one of
+     * `slab_size_classes`, and carved out of 64 KiB slabs; larger ones are
+     * passed to `operator new`.
+     *
+     * Every thread using the pool gets a heap of its own, with a free
+     * list per size class, and allocates from it without locking or
+     * atomic read-modify-writes. A block freed by the thread that
+     * allocated it goes back to its free list; a block freed by another
+     * thread is pushed, lock-free, to the remote free list of the owning
+     * heap, which the owner takes over in one exchange when its own free
+     * list runs dry. The mutex of the pool is only taken for new slabs and
+     * new heaps.
+     *
+     * The heap of an exiting thread, with its free blocks, is handed to
+     * the next thread that starts using the pool. Slabs are only given
+     * back to the system when the pool, and the heaps of every thread
+     * that used it, are gone.
+     * Large allocations aligned to more than `alignof(std::max_align_t)`
+     * need C++17 aligned `new`.
+     */
+    class slab_pool {
+        /// Every slab starts at a multiple of `slab_size`, so the header
+        /// of a block is found by masking its address
+        static EKUTIL_CONSTEXPR_DECL const size_t slab_size = 64 << 10;
+        static EKUTIL_CONSTEXPR_DECL const size_t slabs_per_chunk = 16;
+        static EKUTIL_CONSTEXPR_DECL const size_t classes =
+            slab_size_classes::count;
+
+        struct block {
+            block* next;
+        };
+
+        struct heap;
+
+        struct slab_header {
+            heap* owner;
+            size_t size_class;
+        };
+
+        /// Counter written by one thread at a time, read by any
+        struct owned_counter {
+            std::atomic<uint64_t> value;
+
+            void add(uint64_t n) noexcept
+            {
+                value.store(value.load(std::memory_order_relaxed) + n,
+                            std::memory_order_relaxed);
+            }
+            uint64_t load() const noexcept
+            {
+                return value.load(std::memory_order_relaxed);
+            }
+        };
+
+        /// Placed on a cache line of its own by `state::acquire_heap`
+        struct heap {
+            // Used by the owner thread
+            block* free[classes];
+            char* fresh[classes];
+            char* fresh_end[classes];
+            owned_counter bytes_requested;
+            owned_counter bytes_in_use;
+            owned_counter allocations;
+            owned_counter cache_hits;
+            std::atomic<bool> owned;
+
+            // Pushed to by other threads
+            cacheline_padded<std::atomic<block*>> remote;
+        };
+
+        struct state {
+            state() = default;
+            state(const state&) = delete;
+            state& operator=(const state&) = delete;
+
+            ~state()
+            {
+                for (auto c : chunks) {
+                    ::operator delete(c);
+                }
+            }
+
+            /// A new slab for `cls`, owned by `h`. Takes the lock.
+            char* new_slab(heap& h, size_t cls)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto s = _carve_slab();
+                ::new (static_cast<void*>(s)) slab_header{&h, cls};
+                return s;
+            }
+
+            /// An unowned heap, or a new one. Takes the lock.
+            heap& acquire_heap()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto h : heaps) {
+                    bool expected = false;
+                    if (h->owned.compare_exchange_strong(
+                            expected, true, std::memory_order_acquire)) {
+                        return *h;
+                    }
+                }
+                EKUTIL_CONSTEXPR_DECL const size_t align = alignof(heap);
+                auto size = (sizeof(heap) + align - 1) / align * align;
+                if (static_cast<size_t>(meta_end - meta) < size) {
+                    meta = _carve_slab();
+                    meta_end = meta + slab_size;
+                }
+                auto h = ::new (static_cast<void*>(meta)) heap;
+                meta += size;
+                for (size_t i = 0; i < classes; ++i) {
+                    h->free[i] = nullptr;
+                    h->fresh[i] = nullptr;
+                    h->fresh_end[i] = nullptr;
+                }
+                for (auto c : {&h->bytes_requested, &h->bytes_in_use,
+                               &h->allocations, &h->cache_hits}) {
+                    c->value.store(0, std::memory_order_relaxed);
+                }
+                h->owned.store(true, std::memory_order_relaxed);
+                h->remote->store(nullptr, std::memory_order_relaxed);
+                heaps.push_back(h);
+                return *h;
+            }
+            void release_heap(heap& h) noexcept
+            {
+                h.owned.store(false, std::memory_order_release);
+            }
+
+            std::mutex mutex;
+            std::vector<void*> chunks;
+            std::vector<heap*> heaps;
+            char* next_slab{nullptr};
+            char* slabs_end{nullptr};
+            char* meta{nullptr};
+            char* meta_end{nullptr};
+            uint64_t slab_bytes{0};
+
+            /// Frees bypassing the heap counters
+            distributed_counter remote_frees;
+            distributed_counter remote_bytes_requested;
+            distributed_counter remote_bytes_in_use;
+            distributed_counter large_allocations;
+            distributed_counter large_bytes;
+
+        private:
+            char* _carve_slab()
+            {
+                if (next_slab == slabs_end) {
+                    auto bytes = slabs_per_chunk * slab_size;
+                    chunks.reserve(chunks.size() + 1);
+                    auto c = ::operator new(bytes + slab_size);
+                    chunks.push_back(c);
+                    auto addr = reinterpret_cast<uintptr_t>(c);
+                    addr = (addr + slab_size - 1) & ~uintptr_t{slab_size - 1};
+                    next_slab = reinterpret_cast<char*>(addr);
+                    slabs_end = next_slab + bytes;
+                    slab_bytes += bytes;
+                }
+                auto s = next_slab;
+                next_slab += slab_size;
+                return s;
+            }
+        };
+
+    public:
+        slab_pool() : m_state(std::make_shared<state>()) {}
+
+        slab_pool(const slab_pool&) = delete;
+        slab_pool& operator=(const slab_pool&) = delete;
+
+        /// The heaps of other threads are released when they exit, or
+        /// when they next use a new pool
+        ~slab_pool()
+        {
+            caches::erase(m_state);
+        }
+
+        void* allocate(size_t bytes,
+                       size_t align = alignof(std::max_align_t))
+        {
+            auto cls = slab_size_classes::index(bytes, align);
+            if (EKUTIL_UNLIKELY(cls == slab_size_classes::count)) {
+                return _allocate_large(bytes, align);
+            }
+            if (EKUTIL_UNLIKELY(caches::exited())) {
+                // Caches gone: borrow a heap for this one allocation
+                auto& h = m_state->acquire_heap();
+                auto p = _allocate(h, cls, bytes);
+                m_state->release_heap(h);
+                return p;
+            }
+            return _allocate(*caches::get(m_state).owned, cls, bytes);
+        }
+
+        void deallocate(void* p,
+                        size_t bytes,
+                        size_t align = alignof(std::max_align_t)) noexcept
+        {
+            auto cls = slab_size_classes::index(bytes, align);
+            if (EKUTIL_UNLIKELY(cls == slab_size_classes::count)) {
+                m_state->large_bytes.add(uint64_t(0) - bytes);
+#ifdef __cpp_aligned_new
+                if (align > alignof(std::max_align_t)) {
+                    ::operator delete(p, std::align_val_t(align));
+                    return;
+                }
+#endif
+                ::operator delete(p);
+                return;
+            }
+            auto b = static_cast<block*>(p);
+            auto owner = _slab_of(p)->owner;
+            auto local = caches::exited() ? nullptr : caches::find(m_state);
+            if (local && local->owned == owner) {
+                b->next = owner->free[cls];
+                owner->free[cls] = b;
+                owner->bytes_requested.add(uint64_t(0) - bytes);
+                owner->bytes_in_use.add(uint64_t(0) -
+                                        slab_size_classes::size(cls));
+                return;
+            }
+
+            auto& remote = *owner->remote;
+            auto head = remote.load(std::memory_order_relaxed);
+            do {
+                b->next = head;
+            } while (!remote.compare_exchange_weak(head, b,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+            m_state->remote_frees.add();
+            m_state->remote_bytes_requested.add(bytes);
+            m_state->remote_bytes_in_use.add(slab_size_classes::size(cls));
+        }
+
+        /// Sum the counters of every heap: concurrent allocations may or
+        /// may not be included. Takes the lock.
+        slab_pool_stats stats() const
+        {
+            slab_pool_stats s{};
+            auto& st = *m_state;
+            {
+                std::lock_guard<std::mutex> lock(st.mutex);
+                s.bytes_reserved = st.slab_bytes;
+                for (auto h : st.heaps) {
+                    s.bytes_requested += h->bytes_requested.load();
+                    s.bytes_in_use += h->bytes_in_use.load();
+                    s.allocations += h->allocations.load();
+                    s.cache_hits += h->cache_hits.load();
+                }
+            }
+            auto large = st.large_bytes.load();
+            s.bytes_requested += large - st.remote_bytes_requested.load();
+            s.bytes_in_use += large - st.remote_bytes_in_use.load();
+            s.bytes_reserved += large;
+            s.large_allocations = st.large_allocations.load();
+            s.allocations += s.large_allocations;
+            s.remote_frees = st.remote_frees.load();
+            return s;
+        }
+
+    private:
+        /// The heap of one thread in one pool
+        struct thread_cache {
+            explicit thread_cache(std::shared_ptr<state> s)
+                : owner(std::move(s)), owned(&owner->acquire_heap())
+            {
+            }
+            thread_cache(thread_cache&& other) noexcept
+                : owner(std::move(other.owner)), owned(other.owned)
+            {
+                other.owned = nullptr;
+            }
+            thread_cache& operator=(thread_cache&& other) noexcept
+            {
+                release();
+                owner = std::move(other.owner);
+                owned = other.owned;
+                other.owned = nullptr;
+                return *this;
+            }
+            ~thread_cache()
+            {
+                release();
+            }
+
+            void release() noexcept
+            {
+                if (owned) {
+                    owner->release_heap(*owned);
+                    owned = nullptr;
+                }
+            }
+
+            std::shared_ptr<state> owner;
+            heap* owned;
+        };
+
+        using caches = thread_cache_registry<thread_cache, state>;
+
+        static slab_header* _slab_of(void* p) noexcept
+        {
+            auto addr = reinterpret_cast<uintptr_t>(p);
+            return reinterpret_cast<slab_header*>(addr &
+                                                  ~uintptr_t{slab_size - 1});
+        }
+
+        void* _allocate(heap& h, size_t cls, size_t bytes)
+        {
+            h.allocations.add(1);
+            h.bytes_requested.add(bytes);
+            h.bytes_in_use.add(slab_size_classes::size(cls));
+
+            if (EKUTIL_LIKELY(h.free[cls] != nullptr)) {
+                h.cache_hits.add(1);
+                return _pop(h, cls);
+            }
+            if (h.remote->load(std::memory_order_relaxed)) {
+                _take_remote(h);
+                if (h.free[cls]) {
+                    h.cache_hits.add(1);
+                    return _pop(h, cls);
+                }
+            }
+
+            auto size = slab_size_classes::size(cls);
+            if (static_cast<size_t>(h.fresh_end[cls] - h.fresh[cls]) <
+                size) {
+                try {
+                    auto s = m_state->new_slab(h, cls);
+                    // Blocks aligned to their size's lowest set bit
+                    auto align = std::min(size & (~size + 1),
+                                          size_t{slab_size_classes::max_size});
+                    auto offset = (sizeof(slab_header) + align - 1) /
+                                  align * align;
+                    h.fresh[cls] = s + offset;
+                    h.fresh_end[cls] = s + slab_size;
+                }
+                catch (...) {
+                    h.allocations.add(uint64_t(-1));
+                    h.bytes_requested.add(uint64_t(0) - bytes);
+                    h.bytes_in_use.add(uint64_t(0) - size);
+                    throw;
+                }
+            }
+            auto p = h.fresh[cls];
+            h.fresh[cls] += size;
+            return p;
+        }
+        static void* _pop(heap& h, size_t cls) noexcept
+        {
+            auto b = h.free[cls];
+            h.free[cls] = b->next;
+            return b;
+        }
+        /// Move the blocks freed by other threads to the free lists
+        static void _take_remote(heap& h) noexcept
+        {
+            auto b = h.remote->exchange(nullptr, std::memory_order_acquire);
+            while (b) {
+                auto next = b->next;
+                auto cls = _slab_of(b)->size_class;
+                b->next = h.free[cls];
+                h.free[cls] = b;
+                b = next;
+            }
+        }
+
+        void* _allocate_large(size_t bytes, size_t align)
+        {
+#ifdef __cpp_aligned_new
+            auto p = align > alignof(std::max_align_t)
+                         ? ::operator new(bytes, std::align_val_t(align))
+                         : ::operator new(bytes);
 #else
-            return reinterpret_cast<T*>(std::addressof(data));
+            if (align > alignof(std::max_align_t)) {
+                throw std::bad_alloc{};
+            }
+            auto p = ::operator new(bytes);
 #endif
+            m_state->large_allocations.add();
+            m_state->large_bytes.add(bytes);
+            return p;
+        }
+
+        std::shared_ptr<state> m_state;
+    };
+
+    /// The pool used by default-constructed `slab_allocator`s: never
+    /// destroyed, so that it outlives containers with static storage
+    /// duration
+    inline slab_pool& default_slab_pool()
+    {
+        static auto pool = new slab_pool;
+        return *pool;
+    }
+
+    /**
+     * Standard allocator allocating from a `slab_pool`, by default
+     * `default_slab_pool()`, e.g. for `small_vector` or `small_function`.
+     * Allocators are equal if they use the same pool.
+     */
+    template <typename T>
+    class slab_allocator {
+    public:
+        using value_type = T;
+
+        slab_allocator() noexcept : m_pool(&default_slab_pool()) {}
+        slab_allocator(slab_pool& pool) noexcept : m_pool(&pool) {}
+        template <typename U>
+        slab_allocator(const slab_allocator<U>& other) noexcept
+            : m_pool(&other.pool())
+        {
         }
-        EKUTIL_CONSTEXPR14 T& _get() noexcept
+
+        T* allocate(size_t n)
         {
-            return *m_ptr;
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+                throw std::bad_alloc{};
+            }
+            return static_cast<T*>(
+                m_pool->allocate(n * sizeof(T), alignof(T)));
         }
-        EKUTIL_CONSTEXPR14 const T& _get() const noexcept
+        void deallocate(T* p, size_t n) noexcept
         {
-            return *m_ptr;
+            m_pool->deallocate(p, n * sizeof(T), alignof(T));
         }
 
-        storage_type m_data{};
-        pointer m_ptr{nullptr};
+        /// The size of the class serving `bytes`
+        size_t good_size(size_t bytes) const noexcept
+        {
+            auto cls = slab_size_classes::index(bytes, alignof(T));
+            return cls == slab_size_classes::count
+                       ? bytes
+                       : slab_size_classes::size(cls);
+        }
+
+        slab_pool& pool() const noexcept
+        {
+            return *m_pool;
+        }
+
+    private:
+        slab_pool* m_pool;
     };
 
+    template <typename T, typename U>
+    bool operator==(const slab_allocator<T>& a,
+                    const slab_allocator<U>& b) noexcept
+    {
+        return &a.pool() == &b.pool();
+    }
+    template <typename T, typename U>
+    bool operator!=(const slab_allocator<T>& a,
+                    const slab_allocator<U>& b) noexcept
+    {
+        return !(a == b);
+    }
+
     EKUTIL_CLANG_POP
+
+    static_assert(sizeof(compact_optional<int*>) == sizeof(int*),
+                  "compact_optional: pointer niche unused");
 }  // namespace ekutil
 
 #endif  // EKUTIL_MEMORY_H
@@ -21,6 +21,7 @@
 #include "compat.h"
 
 #include <cstddef>
+#include <cstdint>
 
 namespace ekutil {
 #if EKUTIL_HAS_VOID_T
@@ -53,6 +54,48 @@ namespace ekutil {
         return val > constexpr_max(a...) ? val : constexpr_max(a...);
     }
 
+    /**
+     * A spare bit pattern ("niche") of `T`, which `compact_optional<T>` uses
+     * for its empty state instead of a separate flag.
+     * Specialize with `has_niche = true`, an `empty_value()` that is never
+     * used as a real value, and `is_empty_value(const T&)`. `T` must be
+     * trivially copyable. `value_niche` does this for a constant.
+     */
+    template <typename T, typename = void>
+    struct niche_traits {
+        static EKUTIL_CONSTEXPR_DECL const bool has_niche = false;
+    };
+
+    /// Niche of `T` at the constant `Empty`, like an unused enumerator
+    template <typename T, T Empty>
+    struct value_niche {
+        static EKUTIL_CONSTEXPR_DECL const bool has_niche = true;
+
+        static EKUTIL_CONSTEXPR T empty_value() noexcept
+        {
+            return Empty;
+        }
+        static EKUTIL_CONSTEXPR bool is_empty_value(const T& v) noexcept
+        {
+            return v == Empty;
+        }
+    };
+
+    /// Pointers with all bits set: never a valid address
+    template <typename T>
+    struct niche_traits<T*> {
+        static EKUTIL_CONSTEXPR_DECL const bool has_niche = true;
+
+        static T* empty_value() noexcept
+        {
+            return reinterpret_cast<T*>(~uintptr_t{0});
+        }
+        static bool is_empty_value(T* p) noexcept
+        {
+            return reinterpret_cast<uintptr_t>(p) == ~uintptr_t{0};
+        }
+    };
+
 }  // namespace ekutil
 
 #endif  // EKUTIL_META_H
@@ -24,34 +24,28 @@
 #include <limits>
 
 namespace ekutil {
-    template <typename Integral>
-    int max_digits(int base) noexcept
+    /// Number of digits of `v` in `base`
+    EKUTIL_CONSTEXPR int _digits_of(uint64_t v, uint64_t base) noexcept
     {
-        using lim = std::numeric_limits<Integral>;
-
-        static int base8_digits[4] = {3, 5, 11, 21};
-
-        if (base == 10) {
-            return lim::digits10;
-        }
-        if (base == 8) {
-            return base8_digits[sizeof(Integral) - 1];
-        }
-        if (base == lim::radix) {
-            return lim::digits;
-        }
-
-        auto i = lim::max();
+        return v < base ? 1 : 1 + _digits_of(v / base, base);
+    }
 
-        int digits = 0;
-        while (i) {
-            i /= static_cast<Integral>(base);
-            digits++;
-        }
-        return digits;
+    /**
+     * Most digits of an `Integral` in `base`, not counting a sign: those
+     * of `max()`, or of `-min()`, which can have one more (-128 is
+     * 10000000 in base 2, 127 is 1111111).
+     * A constant expression, to size buffers.
+     */
+    template <typename Integral>
+    EKUTIL_CONSTEXPR int max_digits(int base = 10) noexcept
+    {
+        return _digits_of(
+            static_cast<uint64_t>(std::numeric_limits<Integral>::max()) +
+                (std::numeric_limits<Integral>::is_signed ? 1 : 0),
+            static_cast<uint64_t>(base));
     }
 
-    uint64_t next_pow2(uint64_t x)
+    inline uint64_t next_pow2(uint64_t x)
     {
         --x;
         x |= (x >> 1);
@@ -62,7 +56,7 @@ namespace ekutil {
         x |= (x >> 32);
         return x + 1;
     }
-    uint32_t next_pow2(uint32_t x)
+    inline uint32_t next_pow2(uint32_t x)
     {
         --x;
         x |= (x >> 1);
@@ -72,6 +66,76 @@ namespace ekutil {
         x |= (x >> 16);
         return x + 1;
     }
+
+    /// Number of consecutive zero bits, starting from the least
+    /// significant one: 32 for 0
+    inline int countr_zero(uint32_t x) noexcept
+    {
+        if (x == 0) {
+            return 32;
+        }
+#if EKUTIL_HAS_BUILTIN_BIT_COUNT
+        return __builtin_ctz(x);
+#else
+        int n = 0;
+        for (; (x & 1) == 0; x >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+    /// Number of consecutive zero bits, starting from the least
+    /// significant one: 64 for 0
+    inline int countr_zero(uint64_t x) noexcept
+    {
+        if (x == 0) {
+            return 64;
+        }
+#if EKUTIL_HAS_BUILTIN_BIT_COUNT
+        return __builtin_ctzll(x);
+#else
+        int n = 0;
+        for (; (x & 1) == 0; x >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    /// Number of consecutive zero bits, starting from the most
+    /// significant one: 32 for 0
+    inline int countl_zero(uint32_t x) noexcept
+    {
+        if (x == 0) {
+            return 32;
+        }
+#if EKUTIL_HAS_BUILTIN_BIT_COUNT
+        return __builtin_clz(x);
+#else
+        int n = 0;
+        for (; (x & 0x80000000u) == 0; x <<= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+    /// Number of consecutive zero bits, starting from the most
+    /// significant one: 64 for 0
+    inline int countl_zero(uint64_t x) noexcept
+    {
+        if (x == 0) {
+            return 64;
+        }
+#if EKUTIL_HAS_BUILTIN_BIT_COUNT
+        return __builtin_clzll(x);
+#else
+        int n = 0;
+        for (; (x & 0x8000000000000000u) == 0; x <<= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
 }  // namespace ekutil
 
 #endif  // EKUTIL_NUMERIC_H
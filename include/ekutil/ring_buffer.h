@@ -0,0 +1,372 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_RING_BUFFER_H
+#define EKUTIL_RING_BUFFER_H
+
+#include "memory.h"
+#include "numeric.h"
+#include "span.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ekutil {
+    /// Capacity of a ring buffer holding at least `n` elements
+    inline size_t ring_buffer_capacity(size_t n) noexcept
+    {
+        return n < 2 ? 2
+                     : static_cast<size_t>(
+                           next_pow2(static_cast<uint64_t>(n)));
+    }
+
+    EKUTIL_CLANG_PUSH
+    EKUTIL_CLANG_IGNORE("-Wpadded")
+
+    /**
+     * Bounded wait-free queue for one producer thread and one consumer
+     * thread.
+     * The capacity is rounded up to a power of two. Each side keeps a
+     * cached copy of the other side's index, and only reloads it (a cache
+     * miss) when the queue looks full or empty.
+     */
+    template <typename T>
+    class spsc_queue {
+        using storage_type = basic_stack_storage_type<T>;
+
+    public:
+        using value_type = T;
+
+        explicit spsc_queue(size_t capacity)
+            : m_buffer(make_unique_for_overwrite<storage_type[]>(
+                  ring_buffer_capacity(capacity))),
+              m_mask(ring_buffer_capacity(capacity) - 1)
+        {
+        }
+
+        spsc_queue(const spsc_queue&) = delete;
+        spsc_queue& operator=(const spsc_queue&) = delete;
+
+        ~spsc_queue()
+        {
+            auto head = m_head->index.load(std::memory_order_relaxed);
+            auto tail = m_tail->index.load(std::memory_order_relaxed);
+            for (; head != tail; ++head) {
+                _slot(head)->~T();
+            }
+        }
+
+        size_t capacity() const noexcept
+        {
+            return m_mask + 1;
+        }
+
+        /// Producer: returns false if full
+        template <typename... Args>
+        bool try_emplace(Args&&... args)
+        {
+            auto tail = m_tail->index.load(std::memory_order_relaxed);
+            if (tail - m_tail->cached == capacity()) {
+                m_tail->cached = m_head->index.load(std::memory_order_acquire);
+                if (tail - m_tail->cached == capacity()) {
+                    return false;
+                }
+            }
+            ::new (static_cast<void*>(_slot(tail)))
+                T(std::forward<Args>(args)...);
+            m_tail->index.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        bool try_push(const T& value)
+        {
+            return try_emplace(value);
+        }
+        bool try_push(T&& value)
+        {
+            return try_emplace(std::move(value));
+        }
+
+        /// Producer: push a prefix of `values`, as many as fit, with a
+        /// single publication. Returns the number pushed.
+        /// If a copy throws, nothing is pushed.
+        size_t try_push_n(span<const T> values)
+        {
+            auto tail = m_tail->index.load(std::memory_order_relaxed);
+            auto n = _clamp(values.size(), _free(tail));
+            if (n < static_cast<size_t>(values.size())) {
+                m_tail->cached = m_head->index.load(std::memory_order_acquire);
+                n = _clamp(values.size(), _free(tail));
+            }
+            size_t i = 0;
+            try {
+                for (; i < n; ++i) {
+                    ::new (static_cast<void*>(_slot(tail + i)))
+                        T(values[static_cast<std::ptrdiff_t>(i)]);
+                }
+            }
+            catch (...) {
+                // Unpublished: the next push would construct over them
+                while (i != 0) {
+                    _slot(tail + --i)->~T();
+                }
+                throw;
+            }
+            m_tail->index.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /// Consumer: returns false if empty
+        bool try_pop(T& out)
+        {
+            auto head = m_head->index.load(std::memory_order_relaxed);
+            if (head == m_head->cached) {
+                m_head->cached = m_tail->index.load(std::memory_order_acquire);
+                if (head == m_head->cached) {
+                    return false;
+                }
+            }
+            auto slot = _slot(head);
+            out = std::move(*slot);
+            slot->~T();
+            m_head->index.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer: move up to `out.size()` elements into `out`, releasing
+        /// their slots at once. Returns the number popped.
+        /// If a move throws, the elements moved before it are popped.
+        size_t try_pop_n(span<T> out)
+        {
+            auto head = m_head->index.load(std::memory_order_relaxed);
+            auto n = _clamp(out.size(), m_head->cached - head);
+            if (n < static_cast<size_t>(out.size())) {
+                m_head->cached = m_tail->index.load(std::memory_order_acquire);
+                n = _clamp(out.size(), m_head->cached - head);
+            }
+            size_t i = 0;
+            try {
+                for (; i < n; ++i) {
+                    auto slot = _slot(head + i);
+                    out[static_cast<std::ptrdiff_t>(i)] = std::move(*slot);
+                    slot->~T();
+                }
+            }
+            catch (...) {
+                // Their slots are destroyed already: release them
+                m_head->index.store(head + i, std::memory_order_release);
+                throw;
+            }
+            m_head->index.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        /// Approximate, unless called from the only thread using the queue
+        size_t size() const noexcept
+        {
+            return m_tail->index.load(std::memory_order_acquire) -
+                   m_head->index.load(std::memory_order_acquire);
+        }
+
+    private:
+        T* _slot(size_t i) const noexcept
+        {
+            return reinterpret_cast<T*>(&m_buffer[i & m_mask]);
+        }
+        /// Free slots, as last seen by the producer
+        size_t _free(size_t tail) const noexcept
+        {
+            return capacity() - (tail - m_tail->cached);
+        }
+        static size_t _clamp(std::ptrdiff_t wanted, size_t available) noexcept
+        {
+            return static_cast<size_t>(wanted) < available
+                       ? static_cast<size_t>(wanted)
+                       : available;
+        }
+
+        unique_ptr<storage_type[]> m_buffer;
+        size_t m_mask;
+
+        struct side {
+            std::atomic<size_t> index;
+            /// Last seen index of the other side
+            size_t cached;
+        };
+
+        /// Written by the consumer: head, and cached tail
+        cacheline_padded<side> m_head{};
+        /// Written by the producer: tail, and cached head
+        cacheline_padded<side> m_tail{};
+    };
+
+    /**
+     * Bounded lock-free queue for any number of producers and consumers,
+     * after Dmitry Vyukov's: every slot has a sequence number telling
+     * whether it's ready to be written or read in the current lap, so
+     * producers and consumers only contend on their own index.
+     * The capacity is rounded up to a power of two.
+     */
+    template <typename T>
+    class mpmc_queue {
+        struct cell {
+            std::atomic<size_t> sequence;
+            basic_stack_storage_type<T> storage;
+
+            T* get() noexcept
+            {
+                return reinterpret_cast<T*>(&storage);
+            }
+        };
+
+    public:
+        using value_type = T;
+
+        explicit mpmc_queue(size_t capacity)
+            : m_cells(make_unique<cell[]>(ring_buffer_capacity(capacity))),
+              m_mask(ring_buffer_capacity(capacity) - 1)
+        {
+            for (size_t i = 0; i <= m_mask; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        mpmc_queue(const mpmc_queue&) = delete;
+        mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+        ~mpmc_queue()
+        {
+            auto pos = m_dequeue_pos->load(std::memory_order_relaxed);
+            auto end = m_enqueue_pos->load(std::memory_order_relaxed);
+            for (; pos != end; ++pos) {
+                m_cells[pos & m_mask].get()->~T();
+            }
+        }
+
+        size_t capacity() const noexcept
+        {
+            return m_mask + 1;
+        }
+
+        /// Returns false if full
+        template <typename... Args>
+        bool try_emplace(Args&&... args)
+        {
+            auto pos = m_enqueue_pos->load(std::memory_order_relaxed);
+            for (;;) {
+                auto& c = m_cells[pos & m_mask];
+                auto seq = c.sequence.load(std::memory_order_acquire);
+                auto diff =
+                    static_cast<std::intptr_t>(seq) -
+                    static_cast<std::intptr_t>(pos);
+                if (diff == 0) {
+                    if (m_enqueue_pos->compare_exchange_weak(
+                            pos, pos + 1, std::memory_order_relaxed)) {
+                        ::new (static_cast<void*>(c.get()))
+                            T(std::forward<Args>(args)...);
+                        c.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = m_enqueue_pos->load(std::memory_order_relaxed);
+                }
+            }
+        }
+        bool try_push(const T& value)
+        {
+            return try_emplace(value);
+        }
+        bool try_push(T&& value)
+        {
+            return try_emplace(std::move(value));
+        }
+
+        /// Returns false if empty
+        bool try_pop(T& out)
+        {
+            auto pos = m_dequeue_pos->load(std::memory_order_relaxed);
+            for (;;) {
+                auto& c = m_cells[pos & m_mask];
+                auto seq = c.sequence.load(std::memory_order_acquire);
+                auto diff =
+                    static_cast<std::intptr_t>(seq) -
+                    static_cast<std::intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeue_pos->compare_exchange_weak(
+                            pos, pos + 1, std::memory_order_relaxed)) {
+                        out = std::move(*c.get());
+                        c.get()->~T();
+                        c.sequence.store(pos + m_mask + 1,
+                                         std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = m_dequeue_pos->load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// Push a prefix of `values`, as many as fit.
+        /// Returns the number pushed.
+        size_t try_push_n(span<const T> values)
+        {
+            size_t n = 0;
+            for (auto& v : values) {
+                if (!try_emplace(v)) {
+                    break;
+                }
+                ++n;
+            }
+            return n;
+        }
+        /// Move up to `out.size()` elements into `out`.
+        /// Returns the number popped.
+        size_t try_pop_n(span<T> out)
+        {
+            size_t n = 0;
+            for (auto& v : out) {
+                if (!try_pop(v)) {
+                    break;
+                }
+                ++n;
+            }
+            return n;
+        }
+
+    private:
+        unique_ptr<cell[]> m_cells;
+        size_t m_mask;
+
+        cacheline_padded<std::atomic<size_t>> m_enqueue_pos{};
+        cacheline_padded<std::atomic<size_t>> m_dequeue_pos{};
+    };
+
+    EKUTIL_CLANG_POP
+}  // namespace ekutil
+
+#endif  // EKUTIL_RING_BUFFER_H
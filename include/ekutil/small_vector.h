@@ -20,6 +20,26 @@
 
 #include "memory.h"
 #include "numeric.h"
+#include "span.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#if EKUTIL_SMALL_VECTOR_STATS
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#endif
 
 namespace ekutil {
     template <typename Iter>
@@ -28,17 +48,9 @@ namespace ekutil {
         return std::reverse_iterator<Iter>(i);
     }
 
-    template <typename T>
-    using basic_stack_storage_type =
-        typename std::aligned_storage<sizeof(T), alignof(T)>::type;
-
-    EKUTIL_CLANG_PUSH
-    EKUTIL_CLANG_IGNORE("-Wpadded")
-
     template <typename T, size_t N>
     struct basic_stack_storage {
         basic_stack_storage_type<T> data[N];
-        size_t size{0};
 
         T* get_data()
         {
@@ -50,13 +62,8 @@ namespace ekutil {
         }
     };
 
-    EKUTIL_CLANG_POP
-
     template <typename T>
     struct basic_stack_storage<T, 0> {
-        basic_stack_storage_type<T>* data{nullptr};
-        size_t size{0};
-
         T* get_data()
         {
             return nullptr;
@@ -67,261 +74,492 @@ namespace ekutil {
         }
     };
 
-    EKUTIL_CLANG_PUSH
-    EKUTIL_CLANG_IGNORE("-Wpadded")
+    /**
+     * Type of the size and capacity fields of `small_vector<T, N>`.
+     * 32 bits are plenty for elements of 4 bytes or more: the top bit of
+     * the capacity marks inline storage, which leaves 2^31 - 1 elements
+     * (8 GiB of 4-byte elements). Smaller elements get the full `size_t`
+     * on 64-bit platforms.
+     */
+    template <typename T>
+    using small_vector_size_type =
+        typename std::conditional<sizeof(T) < 4 && sizeof(void*) >= 8,
+                                  size_t,
+                                  uint32_t>::type;
+
+    /**
+     * Growth policies decide the new capacity of a container, when
+     * `required` elements of `elem_size` bytes no longer fit in `cap`.
+     * The result must be at least `required`.
+     * A policy may also take the allocator, as a fourth argument.
+     */
+
+    /// Grow to the next power of two
+    struct pow2_growth {
+        static size_t grow(size_t cap, size_t required, size_t elem_size)
+        {
+            EKUTIL_UNUSED(cap);
+            EKUTIL_UNUSED(elem_size);
+            return static_cast<size_t>(
+                next_pow2(static_cast<uint64_t>(required)));
+        }
+    };
 
-    template <typename T, size_t StackN>
-    class small_vector {
-    public:
-        using value_type = T;
-        using size_type = size_t;
-        using difference_type = std::ptrdiff_t;
-        using reference = T&;
-        using const_reference = const T&;
-        using pointer = T*;
-        using const_pointer = const T*;
-        using iterator = pointer;
-        using const_iterator = const_pointer;
-        using reverse_iterator = std::reverse_iterator<pointer>;
-        using const_reverse_iterator = std::reverse_iterator<const_pointer>;
+    /// Grow by a factor of 1.5, wasting at most a third of the storage
+    struct factor_1_5_growth {
+        static size_t grow(size_t cap, size_t required, size_t elem_size)
+        {
+            EKUTIL_UNUSED(elem_size);
+            return std::max(required, cap + cap / 2);
+        }
+    };
 
-        using stack_storage_type = basic_stack_storage_type<T>;
+    /// Grow to exactly what is required (`reserve` ahead of time!)
+    struct exact_growth {
+        static size_t grow(size_t cap, size_t required, size_t elem_size)
+        {
+            EKUTIL_UNUSED(cap);
+            EKUTIL_UNUSED(elem_size);
+            return required;
+        }
+    };
+
+    /**
+     * Grow by a factor of 1.5, and round the allocation up to what the
+     * allocator really hands out (see `allocator_good_size`), e.g. the size
+     * class of `slab_allocator`, or whole pages of a mapped
+     * `large_buffer_allocator` buffer.
+     * The rounding is turned into extra capacity instead of being wasted.
+     * Allocators that don't tell, like `std::allocator`, get no rounding.
+     */
+    struct size_class_growth {
+        template <typename Allocator>
+        static size_t grow(size_t cap,
+                           size_t required,
+                           size_t elem_size,
+                           const Allocator& alloc)
+        {
+            auto n = factor_1_5_growth::grow(cap, required, elem_size);
+            if (n > std::numeric_limits<size_t>::max() / elem_size) {
+                return n;
+            }
+            auto bytes = allocator_good_size(alloc, n * elem_size);
+            return std::max(n, bytes / elem_size);
+        }
+    };
 
-        struct stack_storage : basic_stack_storage<T, StackN> {
-        };
-        struct heap_storage {
-            pointer ptr{nullptr};
-            size_type size{0};
-            size_type cap{0};
-        };
+    /// Whether `GrowthPolicy::grow` takes the allocator
+    template <typename GrowthPolicy, typename Allocator, typename = void>
+    struct growth_takes_allocator : std::false_type {
+    };
+    template <typename GrowthPolicy, typename Allocator>
+    struct growth_takes_allocator<
+        GrowthPolicy,
+        Allocator,
+        void_t<decltype(GrowthPolicy::grow(size_t{},
+                                           size_t{},
+                                           size_t{},
+                                           std::declval<const Allocator&>()))>>
+        : std::true_type {
+    };
 
-        using storage_type =
-            typename aligned_union<stack_storage, heap_storage>::type;
+    EKUTIL_CLANG_PUSH
+    EKUTIL_CLANG_IGNORE("-Wpadded")
 
-        small_vector() noexcept
+#if EKUTIL_SMALL_VECTOR_STATS
+    /**
+     * Counters of the vectors of one `small_vector<T, N, Allocator,
+     * GrowthPolicy>` instantiation, or of the ones given the same tag with
+     * `small_vector_base::tag_stats`.
+     * Only available with `EKUTIL_SMALL_VECTOR_STATS` defined to 1:
+     * it adds a pointer and a size to every vector, and (sharded) atomic
+     * increments to the construction, growth and destruction of one.
+     * Read the counters with `snapshot_small_vector_stats` or
+     * `dump_small_vector_stats`.
+     */
+    struct small_vector_stats {
+        /// Bucket `k` of `peak_sizes` counts the vectors whose largest size
+        /// had `k` significant bits: 0, 1, 2-3, 4-7, ...
+        static EKUTIL_CONSTEXPR_DECL const size_t histogram_buckets =
+            std::numeric_limits<size_t>::digits + 1;
+
+        small_vector_stats(const char* type,
+                           size_t elem_size,
+                           size_t inline_cap,
+                           const char* tag_name = nullptr,
+                           const small_vector_stats* untagged = nullptr)
+            : small_vector_stats(unlinked{},
+                                 type,
+                                 elem_size,
+                                 inline_cap,
+                                 tag_name,
+                                 untagged)
         {
-            EKUTIL_MSVC_PUSH
-            EKUTIL_MSVC_IGNORE(4127)  // conditional expression is constant
+            std::lock_guard<std::mutex> lock(_registry_mutex());
+            _link();
+        }
 
-            if (StackN != 0) {
-                _construct_stack_storage();
-            }
-            else {
-                _construct_heap_storage();
-            }
+        small_vector_stats(const small_vector_stats&) = delete;
+        small_vector_stats& operator=(const small_vector_stats&) = delete;
 
-            EKUTIL_MSVC_POP
+        /// The record of all vectors of type `Vector`
+        template <typename Vector>
+        static small_vector_stats& get()
+        {
+            static small_vector_stats s(
+                typeid(Vector).name(), sizeof(typename Vector::value_type),
+                Vector::inline_capacity());
+            return s;
         }
 
-        explicit small_vector(size_type count, const T& value)
+        /// The record of the vectors of `untagged` given `tag_name`,
+        /// created on first use. Takes a lock.
+        static small_vector_stats& get_tagged(
+            const small_vector_stats& untagged,
+            const char* tag_name)
         {
-            if (!can_be_small(count)) {
-                _construct_heap_storage();
-                auto cap = next_pow2(count);
-                auto storage_ptr = new stack_storage_type[count];
-                auto ptr = reinterpret_cast<pointer>(storage_ptr);
-                ekutil::uninitialized_fill(ptr, ptr + count, value);
-
-                _get_heap().ptr = ptr;
-                _get_heap().cap = cap;
+            // Held until the new record is linked, or two threads could
+            // both miss it, and create one each
+            std::lock_guard<std::mutex> lock(_registry_mutex());
+            for (auto s = _registry_head(); s; s = s->next) {
+                if (s->parent == &untagged &&
+                    std::strcmp(s->tag, tag_name) == 0) {
+                    return *s;
+                }
             }
-            else {
-                _construct_stack_storage();
-                ekutil::uninitialized_fill(_get_stack().get_data(),
-                                           _get_stack().get_data() + StackN,
-                                           value);
+            // Never freed: vectors may refer to it until exit
+            auto s = new small_vector_stats(
+                unlinked{}, untagged.type_name, untagged.element_size,
+                untagged.inline_capacity, tag_name, &untagged);
+            s->_link();
+            return *s;
+        }
+
+        /// Call `fn(const small_vector_stats&)` for every record
+        template <typename F>
+        static void for_each(F fn)
+        {
+            std::lock_guard<std::mutex> lock(_registry_mutex());
+            for (auto s = _registry_head(); s; s = s->next) {
+                fn(*s);
             }
-            _set_size(count);
         }
 
-        explicit small_vector(size_type count)
+        /// Mangled name of the vector type
+        const char* type_name;
+        /// `nullptr` if not tagged
+        const char* tag;
+        size_t element_size;
+        size_t inline_capacity;
+        /// Untagged record of the same type, if tagged
+        const small_vector_stats* parent;
+
+        // Sharded: vectors of the same type are often created and
+        // destroyed on many threads at once
+
+        /// Vectors constructed
+        distributed_counter vectors;
+        /// Vectors destroyed without ever outgrowing their inline capacity
+        distributed_counter inline_hits;
+        /// Moves from inline storage to the heap
+        distributed_counter spills;
+        /// Heap allocations for elements, spills included
+        distributed_counter reallocs;
+        /// Bytes of elements moved to a new buffer by reallocations
+        distributed_counter bytes_relocated;
+        /// Histogram of the largest size of destroyed vectors
+        distributed_counter_array<histogram_buckets> peak_sizes;
+
+    private:
+        struct unlinked {};
+
+        small_vector_stats(unlinked,
+                           const char* type,
+                           size_t elem_size,
+                           size_t inline_cap,
+                           const char* tag_name,
+                           const small_vector_stats* untagged)
+            : type_name(type),
+              tag(tag_name),
+              element_size(elem_size),
+              inline_capacity(inline_cap),
+              parent(untagged)
         {
-            if (!can_be_small(count)) {
-                _construct_heap_storage();
-                auto cap = next_pow2(count);
-                auto storage_ptr = new stack_storage_type[count];
-                auto ptr = reinterpret_cast<pointer>(storage_ptr);
-                ekutil::uninitialized_fill_default_construct<T>(ptr,
-                                                                ptr + count);
+        }
 
-                _get_heap().ptr = ptr;
-                _get_heap().cap = cap;
-            }
-            else {
-                _construct_stack_storage();
-                ekutil::uninitialized_fill_default_construct<T>(
-                    _get_stack().get_data(), _get_stack().get_data() + count);
-            }
-            _set_size(count);
+        /// Add to the registry, with `_registry_mutex()` held
+        void _link() noexcept
+        {
+            next = _registry_head();
+            _registry_head() = this;
         }
 
-        small_vector(const small_vector& other)
+        static std::mutex& _registry_mutex()
         {
-            if (other.empty()) {
-                _construct_stack_storage();
-                return;
-            }
+            static std::mutex m;
+            return m;
+        }
+        static small_vector_stats*& _registry_head()
+        {
+            static small_vector_stats* head = nullptr;
+            return head;
+        }
 
-            auto s = other.size();
-            if (!other.is_small()) {
-                _construct_heap_storage();
-                auto cap = other.capacity();
-                auto optr = other.data();
+        small_vector_stats* next{nullptr};
+    };
 
-                auto storage_ptr = new stack_storage_type[cap];
-                auto ptr = reinterpret_cast<pointer>(storage_ptr);
-                ekutil::uninitialized_copy(optr, optr + s, ptr);
+    /// The counters of one vector, updating its `small_vector_stats`
+    class small_vector_stats_probe {
+    public:
+        small_vector_stats_probe() = default;
+        small_vector_stats_probe(const small_vector_stats_probe&) = delete;
+        small_vector_stats_probe& operator=(const small_vector_stats_probe&) =
+            delete;
 
-                _get_heap().ptr = ptr;
-                _get_heap().cap = cap;
+        ~small_vector_stats_probe()
+        {
+            if (!m_stats) {
+                return;
             }
-            else {
-                _construct_stack_storage();
-                auto optr = other.data();
-                ekutil::uninitialized_copy(optr, optr + s,
-                                           _get_stack().get_data());
+            if (m_peak <= m_stats->inline_capacity) {
+                m_stats->inline_hits.add();
+            }
+            size_t bucket = 0;
+            for (auto n = m_peak; n != 0; n >>= 1) {
+                ++bucket;
             }
-            _set_size(s);
+            m_stats->peak_sizes.add(bucket);
         }
-        small_vector(small_vector&& other) noexcept
+
+        void attach(small_vector_stats& s) noexcept
         {
-            if (other.empty()) {
-                _construct_stack_storage();
+            if (m_stats) {
+                m_stats->vectors.add(uint64_t(-1));
+            }
+            m_stats = &s;
+            s.vectors.add();
+        }
+        small_vector_stats* get() const noexcept
+        {
+            return m_stats;
+        }
+
+        void track_size(size_t n) noexcept
+        {
+            m_peak = std::max(m_peak, n);
+        }
+        void track_realloc(bool spill, size_t relocated_bytes) noexcept
+        {
+            if (!m_stats) {
                 return;
             }
+            if (spill) {
+                m_stats->spills.add();
+            }
+            m_stats->reallocs.add();
+            m_stats->bytes_relocated.add(relocated_bytes);
+        }
+
+    private:
+        small_vector_stats* m_stats{nullptr};
+        size_t m_peak{0};
+    };
 
-            auto s = other.size();
-            if (other.m_heap) {
-                _construct_heap_storage();
-                _get_heap().ptr = other.data();
-                _get_heap().cap = other.capacity();
+    /// The counters of one `small_vector_stats` at one point in time
+    struct small_vector_stats_snapshot {
+        std::string type_name;
+        std::string tag;
+        size_t element_size;
+        size_t inline_capacity;
+        uint64_t vectors;
+        uint64_t inline_hits;
+        uint64_t spills;
+        uint64_t reallocs;
+        uint64_t bytes_relocated;
+        uint64_t peak_sizes[small_vector_stats::histogram_buckets];
+    };
 
-                other._get_heap().ptr = nullptr;
-                other._get_heap().size = 0;
-                other._get_heap().cap = 0;
+    /// Read the counters of every instantiation and tag used so far
+    inline std::vector<small_vector_stats_snapshot>
+    snapshot_small_vector_stats()
+    {
+        std::vector<small_vector_stats_snapshot> ret;
+        small_vector_stats::for_each([&](const small_vector_stats& s) {
+            small_vector_stats_snapshot snap;
+            snap.type_name = s.type_name;
+            snap.tag = s.tag ? s.tag : "";
+            snap.element_size = s.element_size;
+            snap.inline_capacity = s.inline_capacity;
+            snap.vectors = s.vectors.load();
+            snap.inline_hits = s.inline_hits.load();
+            snap.spills = s.spills.load();
+            snap.reallocs = s.reallocs.load();
+            snap.bytes_relocated = s.bytes_relocated.load();
+            for (size_t i = 0; i < small_vector_stats::histogram_buckets;
+                 ++i) {
+                snap.peak_sizes[i] = s.peak_sizes.load(i);
             }
-            else {
-                _construct_stack_storage();
-                auto optr = other.data();
-                ekutil::uninitialized_move(optr, optr + s,
-                                           _get_stack().get_data());
+            ret.push_back(std::move(snap));
+        });
+        return ret;
+    }
 
-                other._destruct_elements();
-                other._get_stack().size = 0;
+    /// Print the counters, one line per instantiation and tag, followed by
+    /// the nonzero buckets of the peak size histogram
+    inline void dump_small_vector_stats(std::FILE* out = stderr)
+    {
+        for (const auto& s : snapshot_small_vector_stats()) {
+            std::fprintf(out,
+                         "%s%s%s: element_size=%zu inline_capacity=%zu "
+                         "vectors=%" PRIu64 " inline_hits=%" PRIu64
+                         " spills=%" PRIu64 " reallocs=%" PRIu64
+                         " bytes_relocated=%" PRIu64 "\n",
+                         s.type_name.c_str(), s.tag.empty() ? "" : " #",
+                         s.tag.c_str(), s.element_size, s.inline_capacity,
+                         s.vectors, s.inline_hits, s.spills, s.reallocs,
+                         s.bytes_relocated);
+            for (size_t i = 0; i < small_vector_stats::histogram_buckets;
+                 ++i) {
+                if (s.peak_sizes[i] == 0) {
+                    continue;
+                }
+                auto lo = i == 0 ? 0 : uint64_t(1) << (i - 1);
+                auto hi = i == 0 ? 0 : lo + (lo - 1);
+                std::fprintf(out, "    peak %" PRIu64 "-%" PRIu64 ": %" PRIu64
+                             "\n",
+                             lo, hi, s.peak_sizes[i]);
             }
-            _set_size(s);
         }
+    }
+#endif  // EKUTIL_SMALL_VECTOR_STATS
 
-        small_vector& operator=(const small_vector& other)
-        {
-            _destruct_elements();
+    /// A `Base` followed by a `T`, like in `small_vector`
+    template <typename Base, typename T = typename Base::value_type>
+    struct small_vector_layout {
+        alignas(Base) char base[sizeof(Base)];
+        alignas(Base) alignas(T) char first[sizeof(T)];
+    };
 
-            if (other.empty()) {
-                return *this;
-            }
+    /**
+     * The inline elements of a `small_vector` with the header `Base`.
+     * Aligned like `Base` too: the compiler is free to put a base class in
+     * the tail padding of the one before it (the Itanium ABI does), which
+     * would not be where `small_vector_layout` says, e.g. with an
+     * over-aligned allocator in the header.
+     */
+    template <typename Base, size_t N>
+    struct alignas(Base) small_vector_storage
+        : basic_stack_storage<typename Base::value_type, N> {};
+
+    /**
+     * The part of `small_vector<T, N>` that doesn't depend on `N`: all of
+     * it, except for construction and the inline storage itself.
+     * Every `small_vector<T, N, Allocator, GrowthPolicy>` is a
+     * `small_vector_base<T, Allocator, GrowthPolicy>`, so code that doesn't
+     * care about `N` can take one by reference, and isn't instantiated
+     * again for every `N`.
+     *
+     * Heap storage is obtained from `Allocator`, following the standard
+     * allocator model (`std::allocator_traits`, including allocator
+     * propagation on copy, move and swap).
+     * Elements are constructed directly, not through `Allocator::construct`.
+     * When the capacity runs out, `GrowthPolicy` picks the new one: see
+     * `pow2_growth` (the default), `factor_1_5_growth`, `exact_growth` and
+     * `size_class_growth`.
+     *
+     * The object is a pointer to the elements, followed by the size and the
+     * capacity, followed by the inline storage of the derived
+     * `small_vector`. The pointer points to the inline storage, unless the
+     * elements are on the heap, so element access never needs to check
+     * where the elements are. The top bit of the capacity tells which.
+     *
+     * A vector moved from through this interface can't know its inline
+     * capacity: it points back to its inline storage with a capacity of 0,
+     * and spills on the next insertion.
+     */
+    template <typename T,
+              typename Allocator = std::allocator<T>,
+              typename GrowthPolicy = pow2_growth>
+    class small_vector_base : private ebo_storage<Allocator> {
+        using alloc_traits = std::allocator_traits<Allocator>;
+        using alloc_base = ebo_storage<Allocator>;
+        using propagate_on_move =
+            typename alloc_traits::propagate_on_container_move_assignment;
+        using header_size_type = small_vector_size_type<T>;
 
-            // this other
-            // s s      false || true
-            // s h      false || false second
-            // h s      true || true
-            // h h      true || false
-            if (!is_small() || other.is_small()) {
-                ekutil::uninitialized_copy(other.data(),
-                                           other.data() + other.size(), data());
-            }
-            else {
-                _destruct_stack_storage();
-                _construct_heap_storage();
+    public:
+        using value_type = T;
+        using allocator_type = Allocator;
+        using growth_policy = GrowthPolicy;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = T&;
+        using const_reference = const T&;
+        using pointer = T*;
+        using const_pointer = const T*;
+        using iterator = pointer;
+        using const_iterator = const_pointer;
+        using reverse_iterator = std::reverse_iterator<pointer>;
+        using const_reverse_iterator = std::reverse_iterator<const_pointer>;
 
-                auto cap = next_pow2(other.size());
-                auto storage_ptr = new stack_storage_type[cap];
-                auto ptr = reinterpret_cast<pointer>(storage_ptr);
-                ekutil::uninitialized_copy(other.data(),
-                                           other.data() + other.size(), ptr);
-                _get_heap().ptr = ptr;
-            }
-            _set_size(other.size());
+        static_assert(
+            std::is_same<typename alloc_traits::value_type, T>::value,
+            "small_vector: Allocator::value_type must be T");
+        static_assert(std::is_same<typename alloc_traits::pointer, T*>::value,
+                      "small_vector: fancy pointers are not supported");
+
+        small_vector_base(const small_vector_base&) = delete;
+
+        small_vector_base& operator=(const small_vector_base& other)
+        {
+            _copy_assign(other, 0);
             return *this;
         }
 
-        small_vector& operator=(small_vector&& other) noexcept
+        /// May allocate, when `other` has more inline elements than fit
+        /// here: only `small_vector` with the same `N` is `noexcept`
+        small_vector_base& operator=(small_vector_base&& other)
         {
-            _destruct_elements();
-
-            if (other.empty()) {
+            if (this == std::addressof(other)) {
                 return *this;
             }
 
-            if (!is_small() && !other.is_small()) {
-                if (!is_small()) {
-                    if (capacity() != 0) {
-                        delete[] reinterpret_cast<stack_storage_type*>(
-                            _get_heap().ptr);
-                    }
-                }
-
-                _get_heap().ptr = other.data();
-                _get_heap().cap = other.capacity();
-                _get_heap().size = other.size();
-            }
-            else if (!is_small() || other.is_small()) {
-                ekutil::uninitialized_move(other.data(),
-                                           other.data() + other.size(), data());
-                _set_size(other.size());
-                other._destruct_elements();
-            }
-            else {
-                _destruct_stack_storage();
-                _construct_heap_storage();
+            _destruct_elements();
 
-                _get_heap().ptr = other.data();
-                _get_heap().cap = other.capacity();
-                _get_heap().size = other.size();
+            if (!other.is_small() &&
+                (propagate_on_move::value ||
+                 _get_allocator() == other._get_allocator())) {
+                _free_heap();
+                _move_assign_allocator(other, propagate_on_move{});
+                _take_heap(other);
+                return *this;
             }
 
-            other._set_size(0);
-            if (!other.is_small()) {
-                other._get_heap().ptr = nullptr;
-                other._get_heap().cap = 0;
-                other._destruct_heap_storage();
-                other._construct_stack_storage();
+            // Relocate the elements of `other`
+            if (other.size() > capacity()) {
+                _realloc(_grow_capacity(other.size()));
             }
-
+            ekutil::uninitialized_relocate(other.begin(), other.end(), m_ptr);
+            _set_size(other.size());
+            other.m_size = 0;
             return *this;
         }
 
-        ~small_vector()
-        {
-            _destruct();
-        }
-
         pointer data() noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data();
-            }
-            return _get_heap().ptr;
+            return m_ptr;
         }
         const_pointer data() const noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data();
-            }
-            return _get_heap().ptr;
+            return m_ptr;
         }
         size_type size() const noexcept
         {
-            if (is_small()) {
-                return _get_stack().size;
-            }
-            return _get_heap().size;
+            return m_size;
         }
         size_type capacity() const noexcept
         {
-            if (is_small()) {
-                return StackN;
-            }
-            return _get_heap().cap;
+            return m_cap & ~_inline_bit();
         }
 
         bool empty() const noexcept
@@ -329,15 +567,10 @@ namespace ekutil {
             return size() == 0;
         }
 
-        EKUTIL_CONSTEXPR bool is_small() const noexcept
+        bool is_small() const noexcept
         {
-            return !m_heap;
+            return (m_cap & _inline_bit()) != 0;
         }
-        EKUTIL_CONSTEXPR static bool can_be_small(size_type n) noexcept
-        {
-            return n <= StackN;
-        }
-
         reference operator[](size_type pos)
         {
             return *(begin() + pos);
@@ -367,17 +600,11 @@ namespace ekutil {
 
         iterator begin() noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data();
-            }
-            return _get_heap().ptr;
+            return m_ptr;
         }
         const_iterator begin() const noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data();
-            }
-            return _get_heap().ptr;
+            return m_ptr;
         }
         const_iterator cbegin() const noexcept
         {
@@ -386,17 +613,11 @@ namespace ekutil {
 
         iterator end() noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data() + size();
-            }
-            return _get_heap().ptr + size();
+            return m_ptr + m_size;
         }
         const_iterator end() const noexcept
         {
-            if (is_small()) {
-                return _get_stack().get_data() + size();
-            }
-            return _get_heap().ptr + size();
+            return m_ptr + m_size;
         }
         const_iterator cend() const noexcept
         {
@@ -431,235 +652,950 @@ namespace ekutil {
 
         size_type max_size() const noexcept
         {
-            return std::numeric_limits<size_type>::max();
+            return std::min<size_type>(
+                alloc_traits::max_size(_get_allocator()),
+                _inline_bit() - 1);
         }
 
-        void make_small() noexcept
+        allocator_type get_allocator() const noexcept
+        {
+            return _get_allocator();
+        }
+
+        void reserve(size_type new_cap)
         {
-            if (is_small() || !can_be_small(size())) {
+            if (new_cap <= capacity()) {
                 return;
             }
+            _realloc(_grow_capacity(new_cap));
+        }
 
-            stack_storage s;
-            ekutil::uninitialized_move(begin(), end(), s.get_data());
-            s.size = size();
+        void clear() noexcept
+        {
+            _destruct_elements();
+        }
 
-            _destruct();
-            _construct_stack_storage();
-            ekutil::uninitialized_move(s.get_data(), s.get_data() + s.size,
-                                       _get_stack().get_data());
-            _set_size(s.size);
+        /**
+         * Count this vector in `small_vector_stats` under `tag`, from now on.
+         * `tag` must outlive the program.
+         * Does nothing unless `EKUTIL_SMALL_VECTOR_STATS` is 1.
+         */
+        void tag_stats(const char* tag)
+        {
+#if EKUTIL_SMALL_VECTOR_STATS
+            const small_vector_stats* untagged = m_stats.get();
+            if (untagged && untagged->parent) {
+                untagged = untagged->parent;
+            }
+            if (untagged) {
+                m_stats.attach(
+                    small_vector_stats::get_tagged(*untagged, tag));
+            }
+#else
+            EKUTIL_UNUSED(tag);
+#endif
+        }
 
-            for (size_t i = 0; i != s.size; ++i) {
-                _get_stack().get_data()[i].~T();
+        iterator insert(const_iterator pos, const T& value)
+        {
+            return emplace(pos, value);
+        }
+        iterator insert(const_iterator pos, T&& value)
+        {
+            return emplace(pos, std::move(value));
+        }
+        iterator insert(const_iterator pos, size_type count, const T& value)
+        {
+            auto idx = static_cast<size_type>(pos - cbegin());
+            if (count == 0) {
+                return begin() + idx;
+            }
+            // `value` may refer to an element of this vector
+            T tmp(value);
+            if (size() + count > capacity()) {
+                return _insert_realloc(idx, count, [&](pointer dest) {
+                    ekutil::uninitialized_fill(dest, dest + count, tmp);
+                });
+            }
+
+            auto it = begin() + idx;
+            auto tail = static_cast<size_type>(end() - it);
+            if (tail >= count) {
+                ekutil::uninitialized_move(end() - count, end(), end());
+                std::move_backward(it, end() - count, end());
+                std::fill(it, it + count, tmp);
             }
+            else {
+                ekutil::uninitialized_move(it, end(), it + count);
+                ekutil::uninitialized_fill(end(), it + count, tmp);
+                std::fill(it, end(), tmp);
+            }
+            _set_size(size() + count);
+            return it;
+        }
+        template <typename InputIt,
+                  typename = typename std::enable_if<
+                      !std::is_integral<InputIt>::value>::type>
+        iterator insert(const_iterator pos, InputIt first, InputIt last)
+        {
+            return _insert_range(pos, first, last,
+                                 _iterator_category<InputIt>{});
+        }
+        iterator insert(const_iterator pos, std::initializer_list<T> ilist)
+        {
+            return insert(pos, ilist.begin(), ilist.end());
         }
 
-        void reserve(size_type new_cap)
+        template <typename... Args>
+        iterator emplace(const_iterator pos, Args&&... args)
         {
-            if (new_cap <= capacity()) {
-                return;
+            auto idx = static_cast<size_type>(pos - cbegin());
+            if (pos == cend()) {
+                emplace_back(std::forward<Args>(args)...);
+                return begin() + idx;
+            }
+
+            T tmp(std::forward<Args>(args)...);
+            if (size() == capacity()) {
+                return _insert_realloc(idx, 1, [&](pointer dest) {
+                    ::new (static_cast<void*>(dest)) T(std::move(tmp));
+                });
             }
-            _realloc(next_pow2(new_cap));
+
+            auto it = begin() + idx;
+            ::new (static_cast<void*>(end())) T(std::move(back()));
+            std::move_backward(it, end() - 1, end());
+            *it = std::move(tmp);
+            _set_size(size() + 1);
+            return it;
         }
 
-        void shrink_to_fit()
+        template <typename InputIt,
+                  typename = typename std::enable_if<
+                      !std::is_integral<InputIt>::value>::type>
+        void append(InputIt first, InputIt last)
         {
-            if (is_small()) {
+            insert(cend(), first, last);
+        }
+        void append(size_type count, const T& value)
+        {
+            insert(cend(), count, value);
+        }
+        void append(std::initializer_list<T> ilist)
+        {
+            insert(cend(), ilist.begin(), ilist.end());
+        }
+
+        void assign(size_type count, const T& value)
+        {
+            if (count > capacity()) {
+                // `value` may refer to an element of this vector
+                T tmp(value);
+                _destruct_elements();
+                _realloc(_grow_capacity(count));
+                ekutil::uninitialized_fill(begin(), begin() + count, tmp);
+                _set_size(count);
                 return;
             }
-            if (!can_be_small(size())) {
-                _realloc(size());
+
+            auto common = std::min(count, size());
+            std::fill(begin(), begin() + common, value);
+            if (count > size()) {
+                ekutil::uninitialized_fill(end(), begin() + count, value);
             }
             else {
-                make_small();
+                ekutil::destroy(begin() + count, end());
             }
+            _set_size(count);
         }
-
-        void clear() noexcept
+        template <typename InputIt,
+                  typename = typename std::enable_if<
+                      !std::is_integral<InputIt>::value>::type>
+        void assign(InputIt first, InputIt last)
         {
             _destruct_elements();
+            _insert_range(cend(), first, last, _iterator_category<InputIt>{});
+        }
+        void assign(std::initializer_list<T> ilist)
+        {
+            assign(ilist.begin(), ilist.end());
         }
 
         iterator erase(const_iterator pos)
         {
-            if (pos == end()) {
-                pos->~T();
-                --_get_stack().size;
-                return end();
+            return erase(pos, pos + 1);
+        }
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            auto it = begin() + (first - cbegin());
+            if (first == last) {
+                return it;
             }
-            else {
-                for (auto it = pos; it != end(); ++it) {
-                    it->~T();
-                    ::new (static_cast<void*>(it)) T(std::move(*(it + 1)));
-                }
-                (end() - 1)->~T();
-                return pos;
+            auto new_end = std::move(it + (last - first), end(), it);
+            ekutil::destroy(new_end, end());
+            _set_size(static_cast<size_type>(new_end - begin()));
+            return it;
+        }
+
+        /**
+         * Erase the element at `pos` by moving the last element in its
+         * place.
+         * Doesn't preserve the order of the elements, but only moves one.
+         */
+        iterator unordered_erase(const_iterator pos)
+        {
+            auto it = begin() + (pos - cbegin());
+            if (it != end() - 1) {
+                *it = std::move(back());
             }
+            pop_back();
+            return it;
         }
 
         void push_back(const T& value)
         {
-            ::new (_prepare_push_back()) T(value);
-            _set_size(size() + 1);
+            emplace_back(value);
         }
         void push_back(T&& value)
         {
-            ::new (_prepare_push_back()) T(std::move(value));
-            _set_size(size() + 1);
+            emplace_back(std::move(value));
         }
 
         template <typename... Args>
         reference emplace_back(Args&&... args)
         {
-            ::new (_prepare_push_back()) T(std::forward<Args>(args)...);
-            _set_size(size() + 1);
+            if (EKUTIL_UNLIKELY(size() == capacity())) {
+                // Construct before relocating: `args` may refer to an
+                // element of this vector
+                _insert_realloc(size(), 1, [&](pointer dest) {
+                    ::new (static_cast<void*>(dest))
+                        T(std::forward<Args>(args)...);
+                });
+            }
+            else {
+                ::new (static_cast<void*>(end()))
+                    T(std::forward<Args>(args)...);
+                _set_size(size() + 1);
+            }
             return back();
         }
 
         void pop_back()
         {
             back().~T();
-            _set_size(size() - 1);
+            --m_size;
         }
 
         void resize(size_type count)
         {
-            if (count > size()) {
-                return;
+            if (_shrink_or_reserve(count)) {
+                ekutil::uninitialized_fill_default_construct<T>(
+                    end(), begin() + count);
+                _set_size(count);
+            }
+        }
+        void resize(size_type count, const T& value)
+        {
+            if (count > capacity()) {
+                // `value` may refer to an element of this vector
+                T tmp(value);
+                _realloc(_grow_capacity(count));
+                ekutil::uninitialized_fill(end(), begin() + count, tmp);
+                _set_size(count);
             }
-            for (auto it = begin() + count; it != end(); ++it) {
-                it->~T();
+            else if (_shrink_or_reserve(count)) {
+                ekutil::uninitialized_fill(end(), begin() + count, value);
+                _set_size(count);
+            }
+        }
+        /**
+         * Like `resize`, but new elements are default-initialized:
+         * trivial types, like the bytes of an I/O buffer, are left
+         * uninitialized, to be overwritten by the caller.
+         */
+        void resize_for_overwrite(size_type count)
+        {
+            if (_shrink_or_reserve(count)) {
+                ekutil::uninitialized_default_construct(end(),
+                                                        begin() + count);
+                _set_size(count);
             }
-            _set_size(count);
         }
 
-        void swap(small_vector& other) noexcept
+        /**
+         * Grow the vector by `count` default-initialized elements (see
+         * `resize_for_overwrite`), and return a view over them.
+         * Lets e.g. a reader `read()` directly into the end of the vector;
+         * `resize` away whatever wasn't written to.
+         */
+        span<T> append_for_overwrite(size_type count)
         {
-            small_vector tmp{std::move(other)};
-            other = std::move(*this);
-            *this = std::move(tmp);
+            auto old_size = size();
+            resize_for_overwrite(old_size + count);
+            return span<T>(begin() + old_size, end());
         }
 
-    private:
-        void _construct_stack_storage() noexcept
+    protected:
+        small_vector_base(size_type inline_cap, const Allocator& alloc) noexcept
+            : alloc_base(alloc),
+              m_ptr(_inline_data()),
+              m_size(0),
+              m_cap(_inline_capacity(inline_cap))
         {
-            ::new (static_cast<void*>(std::addressof(m_storage)))
-                stack_storage();
-            m_heap = false;
         }
-        void _construct_heap_storage() noexcept
+
+        /// Elements are destroyed by the derived `small_vector`
+        ~small_vector_base()
         {
-            ::new (static_cast<void*>(std::addressof(m_storage)))
-                heap_storage();
-            m_heap = true;
+            _free_heap();
         }
 
-        void _destruct_stack_storage() noexcept
+        /// Where the inline elements of the derived `small_vector` start:
+        /// right after this object
+        pointer _inline_data() noexcept
+        {
+            return reinterpret_cast<pointer>(reinterpret_cast<char*>(this) +
+                                             _inline_offset());
+        }
+        const_pointer _inline_data() const noexcept
         {
-            _get_stack().~stack_storage();
+            return reinterpret_cast<const_pointer>(
+                reinterpret_cast<const char*>(this) + _inline_offset());
         }
-        void _destruct_heap_storage() noexcept
+        static EKUTIL_CONSTEXPR size_t _inline_offset() noexcept
         {
-            if (capacity() != 0) {
-                delete[] reinterpret_cast<stack_storage_type*>(_get_heap().ptr);
+            return offsetof(small_vector_layout<small_vector_base>, first);
+        }
+
+        /// The top bit of the capacity is set while the elements are
+        /// inline. Comparing the pointer with `_inline_data()` would not do:
+        /// without inline elements, that is one past the end of the object,
+        /// where an arena may well put the heap buffer.
+        static EKUTIL_CONSTEXPR header_size_type _inline_bit() noexcept
+        {
+            return static_cast<header_size_type>(
+                header_size_type(1)
+                << (std::numeric_limits<header_size_type>::digits - 1));
+        }
+        static EKUTIL_CONSTEXPR header_size_type _inline_capacity(
+            size_type inline_cap) noexcept
+        {
+            return static_cast<header_size_type>(inline_cap | _inline_bit());
+        }
+
+        /// Point back to the inline storage, which holds `inline_cap`
+        /// elements (0 when not known)
+        void _reset_inline(size_type inline_cap) noexcept
+        {
+            m_ptr = _inline_data();
+            m_cap = _inline_capacity(inline_cap);
+        }
+        /// Construct the elements of an empty vector from `[first, last)`
+        template <typename InputIt>
+        void _init_range(InputIt first, InputIt last)
+        {
+            _init_range(first, last, _iterator_category<InputIt>{});
+        }
+        template <typename ForwardIt>
+        void _init_range(ForwardIt first,
+                         ForwardIt last,
+                         std::forward_iterator_tag)
+        {
+            auto count = static_cast<size_type>(std::distance(first, last));
+            if (count > capacity()) {
+                _track_realloc(0);
+                _set_heap(_allocate(count), count);
             }
-            _get_heap().~heap_storage();
+            ekutil::uninitialized_copy(first, last, m_ptr);
+            _set_size(count);
+        }
+        template <typename InputIt>
+        void _init_range(InputIt first, InputIt last, std::input_iterator_tag)
+        {
+            for (; first != last; ++first) {
+                emplace_back(*first);
+            }
+        }
+        /// Construct the elements of an empty vector as copies of `value`
+        void _init_fill(size_type count, const T& value)
+        {
+            if (count > capacity()) {
+                _track_realloc(0);
+                _set_heap(_allocate(count), count);
+            }
+            ekutil::uninitialized_fill(m_ptr, m_ptr + count, value);
+            _set_size(count);
         }
 
-        void _destruct_elements() noexcept
+        /// Copy assignment, for a vector with `inline_cap` inline elements
+        /// (0 when not known)
+        void _copy_assign(const small_vector_base& other,
+                          size_type inline_cap)
         {
-            if (m_heap) {
-                for (size_type i = 0; i != _get_heap().size; ++i) {
-                    _get_heap().ptr[i].~T();
-                }
+            if (this == std::addressof(other)) {
+                return;
             }
-            else {
-                for (size_type i = 0; i != _get_stack().size; ++i) {
-                    _get_stack().get_data()[i].~T();
+
+            _destruct_elements();
+
+            if (alloc_traits::propagate_on_container_copy_assignment::value) {
+                if (_get_allocator() != other._get_allocator()) {
+                    // Storage from our allocator can't be freed by the new one
+                    _free_heap();
+                    _reset_inline(inline_cap);
                 }
+                _get_allocator() = other._get_allocator();
+            }
+
+            if (other.size() > capacity()) {
+                _realloc(_grow_capacity(other.size()));
             }
-            _set_size(0);
+            ekutil::uninitialized_copy(other.begin(), other.end(), m_ptr);
+            _set_size(other.size());
         }
 
-        void _destruct() noexcept
+        /// Take over the heap buffer of `other`, leaving it empty
+        void _take_heap(small_vector_base& other) noexcept
         {
-            _destruct_elements();
-            if (m_heap) {
-                _destruct_heap_storage();
+            m_ptr = other.m_ptr;
+            m_cap = other.m_cap;
+            _set_size(other.size());
+            other._reset_inline(0);
+            other.m_size = 0;
+        }
+        void _set_heap(pointer ptr, size_type cap) noexcept
+        {
+            m_ptr = ptr;
+            m_cap = static_cast<header_size_type>(cap);
+        }
+        void _set_size(size_type n) noexcept
+        {
+            m_size = static_cast<header_size_type>(n);
+#if EKUTIL_SMALL_VECTOR_STATS
+            m_stats.track_size(n);
+#endif
+        }
+        /// Called before replacing the element buffer, `relocated` elements
+        /// of which are moved over
+        void _track_realloc(size_type relocated) noexcept
+        {
+#if EKUTIL_SMALL_VECTOR_STATS
+            m_stats.track_realloc(is_small(), relocated * sizeof(T));
+#else
+            EKUTIL_UNUSED(relocated);
+#endif
+        }
+#if EKUTIL_SMALL_VECTOR_STATS
+        small_vector_stats_probe& _stats_probe() noexcept
+        {
+            return m_stats;
+        }
+#endif
+
+        /// Shrink to `count`, or make room for growing to it: returns true if
+        /// the elements in `[end(), begin() + count)` are to be constructed
+        bool _shrink_or_reserve(size_type count)
+        {
+            if (count <= size()) {
+                ekutil::destroy(begin() + count, end());
+                _set_size(count);
+                return false;
             }
-            else {
-                _destruct_stack_storage();
+            if (count > capacity()) {
+                _realloc(_grow_capacity(count));
             }
+            return true;
+        }
+        void _free_heap() noexcept
+        {
+            if (!is_small()) {
+                _deallocate(m_ptr, capacity());
+            }
+        }
+        void _destruct_elements() noexcept
+        {
+            ekutil::destroy(begin(), end());
+            m_size = 0;
         }
 
-        void _set_size(size_t n) noexcept
+        /// Capacity to grow to, to fit at least `n` elements
+        size_type _grow_capacity(size_type n) const
         {
-            if (is_small()) {
-                _get_stack().size = n;
+            if (n > max_size()) {
+                throw std::length_error("small_vector: too many elements");
+            }
+            auto cap = _grow(n, growth_takes_allocator<GrowthPolicy,
+                                                       Allocator>{});
+            return std::max(n, std::min(cap, max_size()));
+        }
+        size_type _grow(size_type n, std::true_type) const
+        {
+            return GrowthPolicy::grow(capacity(), n, sizeof(T),
+                                      _get_allocator());
+        }
+        size_type _grow(size_type n, std::false_type) const
+        {
+            return GrowthPolicy::grow(capacity(), n, sizeof(T));
+        }
+
+        template <typename It>
+        using _iterator_category =
+            typename std::iterator_traits<It>::iterator_category;
+
+        template <typename ForwardIt>
+        iterator _insert_range(const_iterator pos,
+                               ForwardIt first,
+                               ForwardIt last,
+                               std::forward_iterator_tag)
+        {
+            auto idx = static_cast<size_type>(pos - cbegin());
+            auto count = static_cast<size_type>(std::distance(first, last));
+            if (count == 0) {
+                return begin() + idx;
+            }
+            if (size() + count > capacity()) {
+                return _insert_realloc(idx, count, [&](pointer dest) {
+                    ekutil::uninitialized_copy(first, last, dest);
+                });
+            }
+
+            auto it = begin() + idx;
+            auto tail = static_cast<size_type>(end() - it);
+            if (tail >= count) {
+                ekutil::uninitialized_move(end() - count, end(), end());
+                std::move_backward(it, end() - count, end());
+                std::copy(first, last, it);
             }
             else {
-                _get_heap().size = n;
+                auto mid = std::next(first, static_cast<difference_type>(tail));
+                ekutil::uninitialized_move(it, end(), it + count);
+                ekutil::uninitialized_copy(mid, last, end());
+                std::copy(first, mid, it);
+            }
+            _set_size(size() + count);
+            return it;
+        }
+        template <typename InputIt>
+        iterator _insert_range(const_iterator pos,
+                               InputIt first,
+                               InputIt last,
+                               std::input_iterator_tag)
+        {
+            // Length unknown up front: append, and rotate into place
+            auto idx = static_cast<difference_type>(pos - cbegin());
+            auto old_size = static_cast<difference_type>(size());
+            for (; first != last; ++first) {
+                emplace_back(*first);
             }
+            std::rotate(begin() + idx, begin() + old_size, end());
+            return begin() + idx;
+        }
+
+        /**
+         * Insert `count` elements at `idx`, when they don't fit in the
+         * current capacity: `construct` creates them directly in the new
+         * buffer, and the old elements are relocated around them.
+         */
+        template <typename Construct>
+        iterator _insert_realloc(size_type idx,
+                                 size_type count,
+                                 Construct construct)
+        {
+            auto new_cap = _grow_capacity(size() + count);
+            if (_can_try_reallocate::value && count == 1 && idx == size() &&
+                !is_small()) {
+                // Appending to a buffer that may be resized in place: the
+                // new element may refer to an old one, so build it aside
+                // before the old ones move
+                basic_stack_storage_type<T> tmp;
+                auto elem = reinterpret_cast<pointer>(&tmp);
+                construct(elem);
+                try {
+                    _realloc(new_cap);
+                }
+                catch (...) {
+                    elem->~T();
+                    throw;
+                }
+                ekutil::uninitialized_relocate(elem, elem + 1, end());
+                _set_size(size() + 1);
+                return begin() + idx;
+            }
+
+            auto ptr = _allocate(new_cap);
+            try {
+                construct(ptr + idx);
+            }
+            catch (...) {
+                _deallocate(ptr, new_cap);
+                throw;
+            }
+            _track_realloc(size());
+            ekutil::uninitialized_relocate(begin(), begin() + idx, ptr);
+            ekutil::uninitialized_relocate(begin() + idx, end(),
+                                           ptr + idx + count);
+            _free_heap();
+            _set_heap(ptr, new_cap);
+            _set_size(size() + count);
+            return begin() + idx;
         }
 
         void _realloc(size_type new_cap)
         {
-            auto storage_ptr = new stack_storage_type[new_cap];
-            auto ptr = reinterpret_cast<pointer>(storage_ptr);
-            auto n = size();
-            ekutil::uninitialized_move(begin(), end(), ptr);
-            _destruct();
+            if (_try_reallocate(new_cap, _can_try_reallocate{})) {
+                return;
+            }
+            auto ptr = _allocate(new_cap);
+            _track_realloc(size());
+            ekutil::uninitialized_relocate(begin(), end(), ptr);
+            _free_heap();
+            _set_heap(ptr, new_cap);
+        }
+
+        using _can_try_reallocate =
+            std::integral_constant<bool,
+                                   has_try_reallocate<Allocator>::value &&
+                                       is_trivially_relocatable<T>::value>;
+
+        /// Resize the heap buffer with `Allocator::try_reallocate`, without
+        /// relocating the elements: returns false if that's not possible
+        bool _try_reallocate(size_type new_cap, std::true_type) noexcept
+        {
             if (is_small()) {
-                _construct_heap_storage();
+                return false;
+            }
+            auto ptr =
+                _get_allocator().try_reallocate(m_ptr, capacity(), new_cap);
+            if (!ptr) {
+                return false;
             }
-            _get_heap().ptr = ptr;
-            _get_heap().size = n;
-            _get_heap().cap = new_cap;
+            _track_realloc(0);
+            _set_heap(ptr, new_cap);
+            return true;
+        }
+        bool _try_reallocate(size_type, std::false_type) noexcept
+        {
+            return false;
         }
 
-        void* _prepare_push_back()
+        pointer _allocate(size_type n)
         {
-            if (size() == capacity()) {
-                _realloc(next_pow2(size() + 1));
+            return alloc_traits::allocate(_get_allocator(), n);
+        }
+        void _deallocate(pointer p, size_type n) noexcept
+        {
+            alloc_traits::deallocate(_get_allocator(), p, n);
+        }
+
+        Allocator& _get_allocator() noexcept
+        {
+            return alloc_base::get_value();
+        }
+        const Allocator& _get_allocator() const noexcept
+        {
+            return alloc_base::get_value();
+        }
+
+        void _move_assign_allocator(small_vector_base& other, std::true_type)
+        {
+            _get_allocator() = std::move(other._get_allocator());
+        }
+        void _move_assign_allocator(small_vector_base&, std::false_type) {}
+
+        /// Swapping vectors with unequal allocators that don't propagate
+        /// on swap is undefined, as for the standard containers
+        void _swap_allocator(small_vector_base& other) noexcept
+        {
+            _swap_allocator(
+                other,
+                typename alloc_traits::propagate_on_container_swap{});
+        }
+        void _swap_allocator(small_vector_base& other, std::true_type) noexcept
+        {
+            using std::swap;
+            swap(_get_allocator(), other._get_allocator());
+        }
+        void _swap_allocator(small_vector_base&, std::false_type) noexcept {}
+
+        void _swap_header(small_vector_base& other) noexcept
+        {
+            std::swap(m_ptr, other.m_ptr);
+            std::swap(m_size, other.m_size);
+            std::swap(m_cap, other.m_cap);
+#if EKUTIL_SMALL_VECTOR_STATS
+            m_stats.track_size(size());
+            other.m_stats.track_size(other.size());
+#endif
+        }
+
+    private:
+        pointer m_ptr;
+        header_size_type m_size;
+        header_size_type m_cap;
+#if EKUTIL_SMALL_VECTOR_STATS
+        small_vector_stats_probe m_stats;
+#endif
+    };
+
+    /**
+     * A vector storing up to `StackN` elements inline, and spilling to the
+     * heap beyond that.
+     * See `small_vector_base` for the operations, and the layout.
+     */
+    template <typename T,
+              size_t StackN,
+              typename Allocator = std::allocator<T>,
+              typename GrowthPolicy = pow2_growth>
+    class small_vector : public small_vector_base<T, Allocator, GrowthPolicy>,
+                         private small_vector_storage<
+                             small_vector_base<T, Allocator, GrowthPolicy>,
+                             StackN> {
+        using base = small_vector_base<T, Allocator, GrowthPolicy>;
+        using storage = small_vector_storage<base, StackN>;
+        using alloc_traits = std::allocator_traits<Allocator>;
+
+    public:
+        using size_type = typename base::size_type;
+        using pointer = typename base::pointer;
+
+        using base::data;
+
+        static_assert(StackN <= (std::numeric_limits<
+                                     small_vector_size_type<T>>::max() >>
+                                 1),
+                      "small_vector: StackN too large");
+
+        using stack_storage_type = basic_stack_storage_type<T>;
+
+        small_vector() noexcept(
+            std::is_nothrow_default_constructible<Allocator>::value)
+            : small_vector(Allocator{})
+        {
+        }
+        explicit small_vector(const Allocator& alloc) noexcept
+            : base(StackN, alloc)
+        {
+#if EKUTIL_SMALL_VECTOR_STATS
+            this->_stats_probe().attach(
+                small_vector_stats::get<small_vector>());
+#endif
+        }
+
+        explicit small_vector(size_type count,
+                              const T& value,
+                              const Allocator& alloc = Allocator{})
+            : small_vector(alloc)
+        {
+            this->_init_fill(count, value);
+        }
+
+        explicit small_vector(size_type count,
+                              const Allocator& alloc = Allocator{})
+            : small_vector(alloc)
+        {
+            this->resize(count);
+        }
+
+        template <typename InputIt,
+                  typename = typename std::enable_if<
+                      !std::is_integral<InputIt>::value>::type>
+        small_vector(InputIt first,
+                     InputIt last,
+                     const Allocator& alloc = Allocator{})
+            : small_vector(alloc)
+        {
+            this->_init_range(first, last);
+        }
+        small_vector(std::initializer_list<T> ilist,
+                     const Allocator& alloc = Allocator{})
+            : small_vector(ilist.begin(), ilist.end(), alloc)
+        {
+        }
+
+        small_vector(const small_vector& other)
+            : small_vector(other,
+                           alloc_traits::select_on_container_copy_construction(
+                               other.get_allocator()))
+        {
+        }
+        small_vector(const small_vector& other, const Allocator& alloc)
+            : small_vector(alloc)
+        {
+            this->_init_range(other.begin(), other.end());
+        }
+        small_vector(small_vector&& other) noexcept
+            : small_vector(other.get_allocator())
+        {
+            if (!other.is_small()) {
+                this->_take_heap(other);
+                other._reset_inline(StackN);
             }
-            if (is_small()) {
-                return _get_stack().data + size();
+            else {
+                base::operator=(std::move(other));
+            }
+        }
+
+        small_vector& operator=(const small_vector& other)
+        {
+            _restore_inline_capacity();
+            this->_copy_assign(other, StackN);
+            return *this;
+        }
+        small_vector& operator=(small_vector&& other) noexcept(
+            alloc_traits::propagate_on_container_move_assignment::value ||
+            std::is_empty<Allocator>::value)
+        {
+            // The inline elements of `other` fit in our inline storage, so
+            // the base doesn't need to allocate for them
+            if (other.is_small() && this->capacity() < other.size() &&
+                this != std::addressof(other)) {
+                this->clear();
+                this->_free_heap();
+                this->_reset_inline(StackN);
+            }
+            base::operator=(std::move(other));
+            _restore_inline_capacity();
+            other._restore_inline_capacity();
+            return *this;
+        }
+
+        ~small_vector()
+        {
+            // The inline elements are where the base looks for them
+            static_assert(StackN == 0 || sizeof(small_vector) ==
+                                             base::_inline_offset() +
+                                                 sizeof(storage),
+                          "small_vector: unexpected layout");
+            this->_destruct_elements();
+        }
+
+        EKUTIL_CONSTEXPR static size_type inline_capacity() noexcept
+        {
+            return StackN;
+        }
+        EKUTIL_CONSTEXPR static bool can_be_small(size_type n) noexcept
+        {
+            return n <= StackN;
+        }
+
+        void make_small() noexcept
+        {
+            if (this->is_small() || !can_be_small(this->size())) {
+                return;
             }
-            return _get_heap().ptr + size();
+
+            auto ptr = this->data();
+            auto cap = this->capacity();
+            this->_reset_inline(StackN);
+            ekutil::uninitialized_relocate(ptr, ptr + this->size(),
+                                           this->data());
+            this->_deallocate(ptr, cap);
         }
 
-        stack_storage& _get_stack() noexcept
+        void shrink_to_fit()
         {
-            return *reinterpret_cast<stack_storage*>(std::addressof(m_storage));
+            if (this->is_small()) {
+                return;
+            }
+            if (!can_be_small(this->size())) {
+                this->_realloc(this->size());
+            }
+            else {
+                make_small();
+            }
         }
-        const stack_storage& _get_stack() const noexcept
+
+        /**
+         * Swap without allocating: heap buffers are exchanged, and only
+         * the elements of an inline side are moved.
+         */
+        void swap(small_vector& other) noexcept
         {
-            return *reinterpret_cast<const stack_storage*>(
-                std::addressof(m_storage));
+            if (this == std::addressof(other)) {
+                return;
+            }
+
+            this->_swap_allocator(other);
+            if (!this->is_small() && !other.is_small()) {
+                this->_swap_header(other);
+            }
+            else if (this->is_small() && other.is_small()) {
+                _swap_inline(other);
+            }
+            else if (this->is_small()) {
+                _swap_inline_heap(*this, other);
+            }
+            else {
+                _swap_inline_heap(other, *this);
+            }
         }
 
-        heap_storage& _get_heap() noexcept
+    private:
+        /// An empty inline vector may have lost its capacity through
+        /// `small_vector_base`
+        void _restore_inline_capacity() noexcept
         {
-            return *reinterpret_cast<heap_storage*>(std::addressof(m_storage));
+            if (this->is_small()) {
+                this->_reset_inline(StackN);
+            }
         }
-        const heap_storage& _get_heap() const noexcept
+
+        /// Swap the common prefix in place, and relocate the rest
+        void _swap_inline(small_vector& other) noexcept
         {
-            return *reinterpret_cast<const heap_storage*>(
-                std::addressof(m_storage));
+            auto& shorter = this->size() <= other.size() ? *this : other;
+            auto& longer = this->size() <= other.size() ? other : *this;
+            auto shorter_size = shorter.size();
+            auto longer_size = longer.size();
+
+            std::swap_ranges(shorter.begin(), shorter.end(), longer.begin());
+            ekutil::uninitialized_relocate(longer.begin() + shorter_size,
+                                           longer.end(), shorter.end());
+            shorter._reset_inline(StackN);
+            shorter._set_size(longer_size);
+            longer._reset_inline(StackN);
+            longer._set_size(shorter_size);
         }
 
-        storage_type m_storage;
-        bool m_heap{false};
+        /// Move the elements of `small` into the inline storage of `large`,
+        /// which hands its heap buffer over to `small`
+        static void _swap_inline_heap(small_vector& small,
+                                      small_vector& large) noexcept
+        {
+            auto ptr = large.data();
+            auto size = large.size();
+            auto cap = large.capacity();
+
+            large._reset_inline(StackN);
+            ekutil::uninitialized_relocate(small.begin(), small.end(),
+                                           large.data());
+            large._set_size(small.size());
+            small._set_heap(ptr, cap);
+            small._set_size(size);
+        }
     };
 
-    template <typename T, size_t N>
-    void swap(small_vector<T, N>& l,
-              small_vector<T, N>& r) noexcept(noexcept(l.swap(r)))
+    template <typename T, size_t N, typename A, typename G>
+    void swap(small_vector<T, N, A, G>& l,
+              small_vector<T, N, A, G>& r) noexcept(noexcept(l.swap(r)))
     {
         l.swap(r);
     }
 
+    /**
+     * Erase all elements satisfying `pred` with a single pass and a single
+     * shift of the remaining elements.
+     * Returns the number of erased elements.
+     */
+    template <typename T, typename A, typename G, typename Predicate>
+    size_t erase_if(small_vector_base<T, A, G>& v, Predicate pred)
+    {
+        auto it = std::remove_if(v.begin(), v.end(), pred);
+        auto n = static_cast<size_t>(v.end() - it);
+        v.erase(it, v.end());
+        return n;
+    }
+
     EKUTIL_CLANG_POP
 }  // namespace ekutil
 
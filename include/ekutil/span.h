@@ -18,7 +18,7 @@
 #ifndef EKUTIL_SPAN_H
 #define EKUTIL_SPAN_H
 
-#include "compat.h"
+#include "meta.h"
 
 #include <iterator>
 #include <type_traits>
@@ -116,6 +116,21 @@ namespace ekutil {
         index_type m_size{0};
     };
 
+    /// A span of negative size
+    template <typename T>
+    struct niche_traits<span<T>> {
+        static EKUTIL_CONSTEXPR_DECL const bool has_niche = true;
+
+        static EKUTIL_CONSTEXPR span<T> empty_value() noexcept
+        {
+            return span<T>(nullptr, -1);
+        }
+        static EKUTIL_CONSTEXPR bool is_empty_value(const span<T>& s) noexcept
+        {
+            return s.size() < 0;
+        }
+    };
+
     template <typename T>
     EKUTIL_CONSTEXPR span<T> make_span(T* ptr, std::ptrdiff_t count) noexcept
     {
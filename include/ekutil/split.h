@@ -0,0 +1,408 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#ifndef EKUTIL_SPLIT_H
+#define EKUTIL_SPLIT_H
+
+#include "char_search.h"
+#include "string_view.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+namespace ekutil {
+    /// Splits on one char
+    struct char_delimiter {
+        explicit char_delimiter(char ch) noexcept : c(ch) {}
+
+        /// Index of the first delimiter in `s`, or `string_view::npos`
+        size_t find(string_view s) const noexcept
+        {
+            return find_char(s.data(), s.size(), c);
+        }
+        size_t size() const noexcept
+        {
+            return 1;
+        }
+
+        char c;
+    };
+
+    /// Splits on a string. An empty one splits off one char at a time.
+    struct string_delimiter {
+        explicit string_delimiter(string_view s) noexcept : str(s) {}
+
+        size_t find(string_view s) const noexcept
+        {
+            if (str.empty()) {
+                return s.size() > 1 ? 1 : string_view::npos;
+            }
+            return find_substring(s.data(), s.size(), str.data(),
+                                  str.size());
+        }
+        size_t size() const noexcept
+        {
+            return str.size();
+        }
+
+        string_view str;
+    };
+
+    /// Splits on any one of a set of chars
+    struct any_of_delimiter {
+        explicit any_of_delimiter(string_view chars) noexcept
+            : set(chars.data(), chars.size())
+        {
+        }
+
+        size_t find(string_view s) const noexcept
+        {
+            return find_char_of(s.data(), s.size(), set);
+        }
+        size_t size() const noexcept
+        {
+            return 1;
+        }
+
+        char_set set;
+    };
+
+    /// Delimiter for `split`: any one of `chars`
+    inline any_of_delimiter any_of(string_view chars) noexcept
+    {
+        return any_of_delimiter(chars);
+    }
+
+    /**
+     * The pieces of a string between delimiters, found one at a time as
+     * the range is iterated, as views into the string.
+     * Like Python's `str.split(sep, maxsplit)`: `n` delimiters make
+     * `n + 1` pieces, some of which may be empty, and after `max_splits`
+     * delimiters the rest of the string is the last piece.
+     * The string, and the range, must outlive the iterators.
+     */
+    template <typename Delimiter>
+    class split_range {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const string_view*;
+            using reference = const string_view&;
+
+            iterator() noexcept = default;
+
+            reference operator*() const noexcept
+            {
+                return m_piece;
+            }
+            pointer operator->() const noexcept
+            {
+                return &m_piece;
+            }
+
+            iterator& operator++() noexcept
+            {
+                _next();
+                return *this;
+            }
+            iterator operator++(int) noexcept
+            {
+                auto it = *this;
+                _next();
+                return it;
+            }
+
+            /// Pieces start at distinct positions, even empty ones
+            friend bool operator==(const iterator& a,
+                                   const iterator& b) noexcept
+            {
+                return a.m_range == b.m_range &&
+                       a.m_piece.data() == b.m_piece.data();
+            }
+            friend bool operator!=(const iterator& a,
+                                   const iterator& b) noexcept
+            {
+                return !(a == b);
+            }
+
+        private:
+            friend class split_range;
+
+            explicit iterator(const split_range* r) noexcept
+                : m_range(r), m_rest(r->m_str), m_splits(r->m_max_splits)
+            {
+                _next();
+            }
+
+            void _next() noexcept
+            {
+                if (m_last) {
+                    m_range = nullptr;
+                    m_piece = string_view();
+                    return;
+                }
+                auto i = m_splits == 0 ? string_view::npos
+                                       : m_range->m_delim.find(m_rest);
+                if (i == string_view::npos) {
+                    m_piece = m_rest;
+                    m_rest.remove_prefix(m_rest.size());
+                    m_last = true;
+                    return;
+                }
+                --m_splits;
+                m_piece = string_view(m_rest.data(), i);
+                m_rest.remove_prefix(i + m_range->m_delim.size());
+            }
+
+            const split_range* m_range{nullptr};
+            string_view m_piece{};
+            string_view m_rest{};
+            size_t m_splits{0};
+            bool m_last{false};
+        };
+        using const_iterator = iterator;
+
+        split_range(string_view s,
+                    Delimiter d,
+                    size_t max_splits = string_view::npos) noexcept
+            : m_str(s), m_delim(d), m_max_splits(max_splits)
+        {
+        }
+
+        iterator begin() const noexcept
+        {
+            return iterator(this);
+        }
+        iterator end() const noexcept
+        {
+            return iterator();
+        }
+
+        const Delimiter& delimiter() const noexcept
+        {
+            return m_delim;
+        }
+
+    private:
+        string_view m_str;
+        Delimiter m_delim;
+        size_t m_max_splits;
+    };
+
+    /// Split `s` on `c`
+    inline split_range<char_delimiter> split(
+        string_view s,
+        char c,
+        size_t max_splits = string_view::npos) noexcept
+    {
+        return {s, char_delimiter(c), max_splits};
+    }
+    /// Split `s` on `delim`
+    inline split_range<string_delimiter> split(
+        string_view s,
+        string_view delim,
+        size_t max_splits = string_view::npos) noexcept
+    {
+        return {s, string_delimiter(delim), max_splits};
+    }
+    /// Split `s` on any of the chars of `delims`, e.g. `any_of(" \t")`
+    inline split_range<any_of_delimiter> split(
+        string_view s,
+        const any_of_delimiter& delims,
+        size_t max_splits = string_view::npos) noexcept
+    {
+        return {s, delims, max_splits};
+    }
+
+    /**
+     * A field read by `csv_tokenizer`, viewing the input. It's only copied
+     * by `value`, and only if it contains escaped quotes.
+     */
+    class csv_field {
+    public:
+        /// The field as in the input, without the enclosing quotes
+        string_view raw() const noexcept
+        {
+            return m_raw;
+        }
+        bool quoted() const noexcept
+        {
+            return m_quoted;
+        }
+        /// Whether `raw` has doubled quotes, each standing for one quote
+        bool escaped() const noexcept
+        {
+            return m_escaped;
+        }
+        /// Whether this is the last field of its record
+        bool last() const noexcept
+        {
+            return m_last;
+        }
+
+        /**
+         * The field with its escapes resolved: `raw` if it has none,
+         * else a view of `buffer` (e.g. a `std::string` or a
+         * `small_vector<char, N>`), into which it's unescaped.
+         */
+        template <typename Buffer>
+        string_view value(Buffer& buffer) const
+        {
+            if (!m_escaped) {
+                return m_raw;
+            }
+            buffer.clear();
+            auto s = m_raw;
+            for (;;) {
+                auto i = find_char(s.data(), s.size(), m_quote);
+                if (i == char_search_npos) {
+                    buffer.insert(buffer.end(), s.data(), s.data() + s.size());
+                    break;
+                }
+                // Keep the first of the two quotes
+                buffer.insert(buffer.end(), s.data(), s.data() + i + 1);
+                s.remove_prefix(std::min(i + 2, s.size()));
+            }
+            return string_view(buffer.data(), buffer.size());
+        }
+
+    private:
+        friend class csv_tokenizer;
+
+        string_view m_raw{};
+        char m_quote{'"'};
+        bool m_quoted{false};
+        bool m_escaped{false};
+        bool m_last{false};
+    };
+
+    /**
+     * Reads the fields of CSV (RFC 4180) records, one at a time, without
+     * copying: fields are separated by `separator`, records by "\n" or
+     * "\r\n", and quoted fields may contain both, with quotes doubled.
+     * Leniently, an unterminated quoted field runs to the end of the
+     * input, and chars between a closing quote and the next separator are
+     * skipped.
+     * Unquoted fields are delimited, and quoted ones closed, by a vector
+     * search for their terminators.
+     */
+    class csv_tokenizer {
+    public:
+        explicit csv_tokenizer(string_view input,
+                               char separator = ',',
+                               char quote = '"') noexcept
+            : m_rest(input),
+              m_terminators(_terminators(separator)),
+              m_separator(separator),
+              m_quote(quote),
+              m_pending(!input.empty())
+        {
+        }
+
+        /// Read the next field into `f`; false at the end of the input
+        bool next(csv_field& f) noexcept
+        {
+            if (!m_pending) {
+                return false;
+            }
+            f.m_quote = m_quote;
+            f.m_escaped = false;
+            f.m_quoted = !m_rest.empty() && m_rest[0] == m_quote;
+            if (f.m_quoted && !_read_quoted(f)) {
+                return true;
+            }
+
+            auto end =
+                find_char_of(m_rest.data(), m_rest.size(), m_terminators);
+            if (!f.m_quoted) {
+                f.m_raw = m_rest.substr(0, end);
+            }
+            if (end == char_search_npos) {
+                m_rest.remove_prefix(m_rest.size());
+                f.m_last = true;
+                m_pending = false;
+                return true;
+            }
+            auto c = m_rest[end];
+            m_rest.remove_prefix(end + 1);
+            if (c == m_separator) {
+                // Even at the end of the input, an empty field follows
+                f.m_last = false;
+                return true;
+            }
+            if (c == '\r' && !m_rest.empty() && m_rest[0] == '\n') {
+                m_rest.remove_prefix(1);
+            }
+            f.m_last = true;
+            m_pending = !m_rest.empty();
+            return true;
+        }
+
+        /// The input not read yet
+        string_view rest() const noexcept
+        {
+            return m_rest;
+        }
+
+    private:
+        static char_set _terminators(char separator) noexcept
+        {
+            char chars[] = {separator, '\n', '\r'};
+            return char_set(chars, sizeof(chars));
+        }
+
+        /// Read a quoted field up to its closing quote, or return false
+        /// if it's unterminated, and so the last one
+        bool _read_quoted(csv_field& f) noexcept
+        {
+            m_rest.remove_prefix(1);
+            size_t i = 0;
+            for (;;) {
+                auto q = find_char(m_rest.data() + i, m_rest.size() - i,
+                                   m_quote);
+                if (q == char_search_npos) {
+                    f.m_raw = m_rest;
+                    f.m_last = true;
+                    m_rest.remove_prefix(m_rest.size());
+                    m_pending = false;
+                    return false;
+                }
+                i += q;
+                if (i + 1 < m_rest.size() && m_rest[i + 1] == m_quote) {
+                    f.m_escaped = true;
+                    i += 2;
+                    continue;
+                }
+                f.m_raw = string_view(m_rest.data(), i);
+                m_rest.remove_prefix(i + 1);
+                return true;
+            }
+        }
+
+        string_view m_rest;
+        char_set m_terminators;
+        char m_separator;
+        char m_quote;
+        bool m_pending;
+    };
+}  // namespace ekutil
+
+#endif  // EKUTIL_SPLIT_H
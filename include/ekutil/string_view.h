@@ -18,9 +18,14 @@
 #ifndef EKUTIL_STRING_VIEW_H
 #define EKUTIL_STRING_VIEW_H
 
+#include "char_search.h"
+#include "hash.h"
 #include "span.h"
 
+#include <algorithm>
 #include <limits>
+#include <string>
+#include <type_traits>
 
 namespace ekutil {
     /**
@@ -159,7 +164,7 @@ namespace ekutil {
         substr(size_type pos = 0, size_type count = npos) const
         {
             auto n = std::min(count, size() - pos);
-            return m_data.subspan(pos, n);
+            return basic_string_view(data() + pos, n);
         }
 
         int compare(basic_string_view v) const noexcept
@@ -205,10 +210,396 @@ namespace ekutil {
             return substr(pos1, count1).compare(basic_string_view(s, count2));
         }
 
+        EKUTIL_CONSTEXPR14 bool starts_with(basic_string_view v) const noexcept
+        {
+            return size() >= v.size() &&
+                   Traits::compare(data(), v.data(), v.size()) == 0;
+        }
+        EKUTIL_CONSTEXPR bool starts_with(value_type c) const noexcept
+        {
+            return !empty() && Traits::eq(front(), c);
+        }
+        EKUTIL_CONSTEXPR14 bool starts_with(const_pointer s) const
+        {
+            return starts_with(basic_string_view(s));
+        }
+
+        EKUTIL_CONSTEXPR14 bool ends_with(basic_string_view v) const noexcept
+        {
+            return size() >= v.size() &&
+                   Traits::compare(data() + (size() - v.size()), v.data(),
+                                   v.size()) == 0;
+        }
+        EKUTIL_CONSTEXPR bool ends_with(value_type c) const noexcept
+        {
+            return !empty() && Traits::eq(back(), c);
+        }
+        EKUTIL_CONSTEXPR14 bool ends_with(const_pointer s) const
+        {
+            return ends_with(basic_string_view(s));
+        }
+
+        bool contains(basic_string_view v) const noexcept
+        {
+            return find(v) != npos;
+        }
+        bool contains(value_type c) const noexcept
+        {
+            return find(c) != npos;
+        }
+        bool contains(const_pointer s) const
+        {
+            return find(s) != npos;
+        }
+
+        /*
+         * Searching: the same overloads as `std::basic_string_view`.
+         * Views of `char` with the default traits use the vectorized
+         * functions of char_search.h.
+         */
+
+        size_type find(basic_string_view v, size_type pos = 0) const noexcept
+        {
+            if (pos > size()) {
+                return npos;
+            }
+            return _offset(pos, _find(data() + pos, size() - pos, v.data(),
+                                      v.size(), _char_kernels{}));
+        }
+        size_type find(value_type c, size_type pos = 0) const noexcept
+        {
+            if (pos >= size()) {
+                return npos;
+            }
+            return _offset(pos, _find_char(data() + pos, size() - pos, c,
+                                           _char_kernels{}));
+        }
+        size_type find(const_pointer s, size_type pos, size_type count) const
+        {
+            return find(basic_string_view(s, count), pos);
+        }
+        size_type find(const_pointer s, size_type pos = 0) const
+        {
+            return find(basic_string_view(s), pos);
+        }
+
+        size_type rfind(basic_string_view v, size_type pos = npos) const
+            noexcept
+        {
+            if (v.size() > size()) {
+                return npos;
+            }
+            auto n = std::min(pos, size() - v.size()) + v.size();
+            return _rfind(data(), n, v.data(), v.size(), _char_kernels{});
+        }
+        size_type rfind(value_type c, size_type pos = npos) const noexcept
+        {
+            if (empty()) {
+                return npos;
+            }
+            return _rfind_char(data(), _prefix(pos), c, _char_kernels{});
+        }
+        size_type rfind(const_pointer s, size_type pos, size_type count) const
+        {
+            return rfind(basic_string_view(s, count), pos);
+        }
+        size_type rfind(const_pointer s, size_type pos = npos) const
+        {
+            return rfind(basic_string_view(s), pos);
+        }
+
+        size_type find_first_of(basic_string_view v, size_type pos = 0) const
+            noexcept
+        {
+            if (pos >= size()) {
+                return npos;
+            }
+            return _offset(pos,
+                           _find_of(data() + pos, size() - pos, v.data(),
+                                    v.size(), false, _char_kernels{}));
+        }
+        size_type find_first_of(value_type c, size_type pos = 0) const
+            noexcept
+        {
+            return find(c, pos);
+        }
+        size_type find_first_of(const_pointer s,
+                                size_type pos,
+                                size_type count) const
+        {
+            return find_first_of(basic_string_view(s, count), pos);
+        }
+        size_type find_first_of(const_pointer s, size_type pos = 0) const
+        {
+            return find_first_of(basic_string_view(s), pos);
+        }
+
+        size_type find_last_of(basic_string_view v,
+                               size_type pos = npos) const noexcept
+        {
+            if (empty()) {
+                return npos;
+            }
+            return _rfind_of(data(), _prefix(pos), v.data(), v.size(), false,
+                             _char_kernels{});
+        }
+        size_type find_last_of(value_type c, size_type pos = npos) const
+            noexcept
+        {
+            return rfind(c, pos);
+        }
+        size_type find_last_of(const_pointer s,
+                               size_type pos,
+                               size_type count) const
+        {
+            return find_last_of(basic_string_view(s, count), pos);
+        }
+        size_type find_last_of(const_pointer s, size_type pos = npos) const
+        {
+            return find_last_of(basic_string_view(s), pos);
+        }
+
+        size_type find_first_not_of(basic_string_view v,
+                                    size_type pos = 0) const noexcept
+        {
+            if (pos >= size()) {
+                return npos;
+            }
+            return _offset(pos,
+                           _find_of(data() + pos, size() - pos, v.data(),
+                                    v.size(), true, _char_kernels{}));
+        }
+        size_type find_first_not_of(value_type c, size_type pos = 0) const
+            noexcept
+        {
+            return find_first_not_of(basic_string_view(&c, 1), pos);
+        }
+        size_type find_first_not_of(const_pointer s,
+                                    size_type pos,
+                                    size_type count) const
+        {
+            return find_first_not_of(basic_string_view(s, count), pos);
+        }
+        size_type find_first_not_of(const_pointer s, size_type pos = 0) const
+        {
+            return find_first_not_of(basic_string_view(s), pos);
+        }
+
+        size_type find_last_not_of(basic_string_view v,
+                                   size_type pos = npos) const noexcept
+        {
+            if (empty()) {
+                return npos;
+            }
+            return _rfind_of(data(), _prefix(pos), v.data(), v.size(), true,
+                             _char_kernels{});
+        }
+        size_type find_last_not_of(value_type c, size_type pos = npos) const
+            noexcept
+        {
+            return find_last_not_of(basic_string_view(&c, 1), pos);
+        }
+        size_type find_last_not_of(const_pointer s,
+                                   size_type pos,
+                                   size_type count) const
+        {
+            return find_last_not_of(basic_string_view(s, count), pos);
+        }
+        size_type find_last_not_of(const_pointer s,
+                                   size_type pos = npos) const
+        {
+            return find_last_not_of(basic_string_view(s), pos);
+        }
+
     private:
+        using _char_kernels = std::integral_constant<
+            bool,
+            std::is_same<CharT, char>::value &&
+                std::is_same<Traits, std::char_traits<char>>::value>;
+
+        static size_type _offset(size_type pos, size_type i) noexcept
+        {
+            return i == npos ? npos : pos + i;
+        }
+        /// Length of the prefix ending at `pos`, for a search backwards
+        size_type _prefix(size_type pos) const noexcept
+        {
+            return std::min(pos, size() - 1) + 1;
+        }
+
+        static size_type _find(const char* s,
+                               size_type n,
+                               const char* t,
+                               size_type m,
+                               std::true_type) noexcept
+        {
+            return find_substring(s, n, t, m);
+        }
+        static size_type _find(const_pointer s,
+                               size_type n,
+                               const_pointer t,
+                               size_type m,
+                               std::false_type) noexcept
+        {
+            for (size_type i = 0; i + m <= n; ++i) {
+                if (Traits::compare(s + i, t, m) == 0) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+        static size_type _rfind(const char* s,
+                                size_type n,
+                                const char* t,
+                                size_type m,
+                                std::true_type) noexcept
+        {
+            return rfind_substring(s, n, t, m);
+        }
+        static size_type _rfind(const_pointer s,
+                                size_type n,
+                                const_pointer t,
+                                size_type m,
+                                std::false_type) noexcept
+        {
+            for (auto i = n - m + 1; i-- > 0;) {
+                if (Traits::compare(s + i, t, m) == 0) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+
+        static size_type _find_char(const char* s,
+                                    size_type n,
+                                    char c,
+                                    std::true_type) noexcept
+        {
+            return find_char(s, n, c);
+        }
+        static size_type _find_char(const_pointer s,
+                                    size_type n,
+                                    value_type c,
+                                    std::false_type) noexcept
+        {
+            auto p = Traits::find(s, n, c);
+            return p ? static_cast<size_type>(p - s) : npos;
+        }
+        static size_type _rfind_char(const char* s,
+                                     size_type n,
+                                     char c,
+                                     std::true_type) noexcept
+        {
+            return rfind_char(s, n, c);
+        }
+        static size_type _rfind_char(const_pointer s,
+                                     size_type n,
+                                     value_type c,
+                                     std::false_type) noexcept
+        {
+            while (n-- > 0) {
+                if (Traits::eq(s[n], c)) {
+                    return n;
+                }
+            }
+            return npos;
+        }
+
+        /// First char of `[s, s + n)` in `[t, t + m)`, or not in it if
+        /// `negate`
+        static size_type _find_of(const char* s,
+                                  size_type n,
+                                  const char* t,
+                                  size_type m,
+                                  bool negate,
+                                  std::true_type) noexcept
+        {
+            char_set set(t, m);
+            return negate ? find_char_not_of(s, n, set)
+                          : find_char_of(s, n, set);
+        }
+        static size_type _find_of(const_pointer s,
+                                  size_type n,
+                                  const_pointer t,
+                                  size_type m,
+                                  bool negate,
+                                  std::false_type) noexcept
+        {
+            for (size_type i = 0; i < n; ++i) {
+                if ((Traits::find(t, m, s[i]) != nullptr) != negate) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+        static size_type _rfind_of(const char* s,
+                                   size_type n,
+                                   const char* t,
+                                   size_type m,
+                                   bool negate,
+                                   std::true_type) noexcept
+        {
+            char_set set(t, m);
+            return negate ? rfind_char_not_of(s, n, set)
+                          : rfind_char_of(s, n, set);
+        }
+        static size_type _rfind_of(const_pointer s,
+                                   size_type n,
+                                   const_pointer t,
+                                   size_type m,
+                                   bool negate,
+                                   std::false_type) noexcept
+        {
+            while (n-- > 0) {
+                if ((Traits::find(t, m, s[n]) != nullptr) != negate) {
+                    return n;
+                }
+            }
+            return npos;
+        }
+
         span_type m_data{};
     };
 
+    /// A view of `npos` characters
+    template <typename CharT, typename Traits>
+    struct niche_traits<basic_string_view<CharT, Traits>> {
+        using view_type = basic_string_view<CharT, Traits>;
+
+        static EKUTIL_CONSTEXPR_DECL const bool has_niche = true;
+
+        static EKUTIL_CONSTEXPR view_type empty_value() noexcept
+        {
+            return view_type(nullptr, view_type::npos);
+        }
+        static EKUTIL_CONSTEXPR bool is_empty_value(const view_type& v) noexcept
+        {
+            return v.size() == view_type::npos;
+        }
+    };
+
+    template <typename CharT, typename Traits>
+    bool operator==(basic_string_view<CharT, Traits> a,
+                    basic_string_view<CharT, Traits> b) noexcept
+    {
+        return a.size() == b.size() &&
+               Traits::compare(a.data(), b.data(), a.size()) == 0;
+    }
+    template <typename CharT, typename Traits>
+    bool operator!=(basic_string_view<CharT, Traits> a,
+                    basic_string_view<CharT, Traits> b) noexcept
+    {
+        return !(a == b);
+    }
+
+    /// Hash the characters of `s`, as `hash_bytes`
+    template <typename CharT, typename Traits>
+    uint64_t hash(basic_string_view<CharT, Traits> s,
+                  uint64_t seed = 0) noexcept
+    {
+        return hash_bytes(s.data(), s.size() * sizeof(CharT), seed);
+    }
+
     using string_view = basic_string_view<char>;
     using wstring_view = basic_string_view<wchar_t>;
     using u16string_view = basic_string_view<char>;
@@ -216,4 +607,17 @@ namespace ekutil {
 
 }  // namespace ekutil
 
+#if EKUTIL_STL_OVERLOADS
+namespace std {
+    template <typename CharT, typename Traits>
+    struct hash<ekutil::basic_string_view<CharT, Traits>> {
+        size_t operator()(
+            ekutil::basic_string_view<CharT, Traits> s) const noexcept
+        {
+            return static_cast<size_t>(ekutil::hash(s));
+        }
+    };
+}  // namespace std
+#endif
+
 #endif  // EKUTIL_STRING_VIEW_H
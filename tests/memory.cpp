@@ -0,0 +1,149 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/memory.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Not assert: the tests are built in release mode too
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, \
+                         __LINE__, #cond);                               \
+            std::abort();                                                \
+        }                                                                \
+    } while (false)
+
+namespace {
+    /// Counts the calls to the global `operator new` on each thread
+    thread_local int heap_allocations = 0;
+}  // namespace
+
+void* operator new(size_t size)
+{
+    ++heap_allocations;
+    if (auto p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+    using ekutil::unique_ptr;
+
+    struct base {
+        int x;
+    };
+    struct derived : base {
+        int y;
+    };
+
+    template <typename Ptr, typename U, typename = void>
+    struct can_reset : std::false_type {};
+    template <typename Ptr, typename U>
+    struct can_reset<
+        Ptr,
+        U,
+        decltype(std::declval<Ptr&>().reset(std::declval<U>()))>
+        : std::true_type {};
+
+    // An array of derived objects can't be deleted through a pointer to
+    // the base
+    static_assert(!std::is_constructible<unique_ptr<base[]>, derived*>::value,
+                  "unique_ptr<T[]>: takes a pointer to derived");
+    static_assert(!can_reset<unique_ptr<base[]>, derived*>::value,
+                  "unique_ptr<T[]>: takes a pointer to derived");
+    static_assert(std::is_constructible<unique_ptr<const base[]>,
+                                        base*>::value,
+                  "unique_ptr<T[]>: rejects a less qualified pointer");
+    static_assert(!std::is_constructible<unique_ptr<base[]>,
+                                         const base*>::value,
+                  "unique_ptr<T[]>: drops qualifiers");
+    static_assert(!std::is_convertible<base*, unique_ptr<base[]>>::value,
+                  "unique_ptr<T[]>: implicit from a pointer");
+    static_assert(can_reset<unique_ptr<base[]>, std::nullptr_t>::value,
+                  "unique_ptr<T[]>: can't be reset to null");
+    static_assert(std::is_constructible<unique_ptr<base>, derived*>::value,
+                  "unique_ptr<T>: rejects a pointer to derived");
+
+    void test_unique_array()
+    {
+        unique_ptr<int[]> p(new int[2]{1, 2});
+        CHECK(p[0] == 1 && p[1] == 2);
+        p.reset(new int[3]());
+        CHECK(p[2] == 0);
+        p = nullptr;
+        CHECK(!p);
+
+        unique_ptr<const int[]> c(new int[1]{3},
+                                  std::default_delete<const int[]>());
+        CHECK(c[0] == 3);
+        unique_ptr<const int[]> moved(std::move(c));
+        CHECK(!c && moved[0] == 3);
+    }
+
+    // Freeing on a thread that never allocated from the pool goes to the
+    // shared depot, without allocating
+    void test_object_pool_remote_free()
+    {
+        ekutil::object_pool<long> pool;
+        std::vector<void*> slots;
+        for (int i = 0; i < 100; ++i) {
+            slots.push_back(pool.allocate());
+        }
+        auto capacity = pool.capacity();
+
+        int allocations = -1;
+        std::thread([&] {
+            auto before = heap_allocations;
+            for (auto p : slots) {
+                pool.deallocate(p);
+            }
+            allocations = heap_allocations - before;
+        }).join();
+        CHECK(allocations == 0);
+
+        for (auto& p : slots) {
+            p = pool.allocate();
+        }
+        CHECK(pool.capacity() == capacity);
+        for (auto p : slots) {
+            pool.deallocate(p);
+        }
+    }
+}  // namespace
+
+int main()
+{
+    test_unique_array();
+    test_object_pool_remote_free();
+}
@@ -0,0 +1,127 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/ring_buffer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+// Not assert: the tests are built in release mode too
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, \
+                         __LINE__, #cond);                               \
+            std::abort();                                                \
+        }                                                                \
+    } while (false)
+
+namespace {
+    using ekutil::span;
+
+    /// Counts live objects, and throws when copying or moving the value
+    /// `poison`
+    struct tracked {
+        static int live;
+        static int poison;
+
+        explicit tracked(int v) : value(v)
+        {
+            ++live;
+        }
+        tracked(const tracked& other) : value(other.value)
+        {
+            if (value == poison) {
+                throw std::runtime_error("copy");
+            }
+            ++live;
+        }
+        tracked& operator=(tracked&& other)
+        {
+            if (other.value == poison) {
+                throw std::runtime_error("move");
+            }
+            value = other.value;
+            return *this;
+        }
+        ~tracked()
+        {
+            --live;
+        }
+
+        int value;
+    };
+    int tracked::live = 0;
+    int tracked::poison = -1;
+
+    void test_push_n_throws()
+    {
+        {
+            ekutil::spsc_queue<tracked> q(8);
+            tracked values[] = {tracked(0), tracked(1), tracked(2)};
+            tracked::poison = 2;
+            bool thrown = false;
+            try {
+                q.try_push_n(span<const tracked>(values, 3));
+            }
+            catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+            CHECK(q.size() == 0 && tracked::live == 3);
+
+            tracked::poison = -1;
+            CHECK(q.try_push_n(span<const tracked>(values, 3)) == 3);
+            CHECK(tracked::live == 6);
+        }
+        CHECK(tracked::live == 0);
+    }
+
+    void test_pop_n_throws()
+    {
+        {
+            ekutil::spsc_queue<tracked> q(8);
+            tracked values[] = {tracked(0), tracked(1), tracked(2)};
+            CHECK(q.try_push_n(span<const tracked>(values, 3)) == 3);
+
+            tracked out[] = {tracked(-1), tracked(-1), tracked(-1)};
+            tracked::poison = 1;
+            bool thrown = false;
+            try {
+                q.try_pop_n(span<tracked>(out, 3));
+            }
+            catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+            CHECK(q.size() == 2 && out[0].value == 0);
+
+            tracked::poison = -1;
+            CHECK(q.try_pop_n(span<tracked>(out, 3)) == 2);
+            CHECK(out[0].value == 1 && out[1].value == 2);
+            CHECK(q.size() == 0 && tracked::live == 6);
+        }
+        CHECK(tracked::live == 0);
+    }
+}  // namespace
+
+int main()
+{
+    test_push_n_throws();
+    test_pop_n_throws();
+}
@@ -0,0 +1,371 @@
+// Copyright 2018-2019 Elias Kosunen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file is a part of ekutil:
+//     https://github.com/eliaskosunen/ekutil
+
+#include <ekutil/memory.h>
+#include <ekutil/small_vector.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Not assert: the tests are built in release mode too
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, \
+                         __LINE__, #cond);                               \
+            std::abort();                                                \
+        }                                                                \
+    } while (false)
+
+namespace {
+    using ekutil::small_vector;
+    using ekutil::small_vector_size_type;
+
+    // Layout: the header is a pointer and two size fields (and the stats
+    // probe, if enabled), the inline elements follow without padding
+#if EKUTIL_SMALL_VECTOR_STATS
+    constexpr size_t probe_size = sizeof(ekutil::small_vector_stats_probe);
+#else
+    constexpr size_t probe_size = 0;
+#endif
+    static_assert(sizeof(small_vector<int, 0>) ==
+                      sizeof(void*) + 2 * sizeof(small_vector_size_type<int>) +
+                          probe_size,
+                  "unexpected header size");
+    static_assert(sizeof(small_vector<int, 4>) ==
+                      sizeof(small_vector<int, 0>) + 4 * sizeof(int),
+                  "unexpected padding");
+    static_assert(sizeof(small_vector<void*, 2>) ==
+                      sizeof(small_vector<void*, 0>) + 2 * sizeof(void*),
+                  "unexpected padding");
+    static_assert(sizeof(small_vector<char, 8>) ==
+                      sizeof(void*) + 2 * sizeof(size_t) + probe_size + 8,
+                  "unexpected padding");
+
+    void test_inline_and_heap()
+    {
+        small_vector<int, 4> v;
+        CHECK(v.is_small() && v.capacity() == 4);
+        for (int i = 0; i < 4; ++i) {
+            v.push_back(i);
+        }
+        CHECK(v.is_small());
+        v.push_back(4);
+        CHECK(!v.is_small() && v.capacity() >= 5);
+        v.resize(2);
+        v.shrink_to_fit();
+        CHECK(v.is_small() && v.capacity() == 4);
+        CHECK(v.size() == 2 && v[0] == 0 && v[1] == 1);
+
+        small_vector<int, 0> z;
+        CHECK(z.is_small() && z.capacity() == 0);
+        z.push_back(1);
+        CHECK(!z.is_small() && z.capacity() >= 1);
+    }
+
+    // With no inline elements, the inline storage is one past the end of
+    // the vector, where an arena puts the next allocation
+    void test_no_inline_in_arena()
+    {
+        using vector = small_vector<int, 0, ekutil::arena_allocator<int>>;
+
+        ekutil::monotonic_arena arena(4096);
+        ekutil::arena_allocator<int> alloc(arena);
+        auto mem = arena.allocate(sizeof(vector), alignof(vector));
+        auto v = ::new (mem) vector(alloc);
+
+        v->push_back(1);
+        CHECK(static_cast<void*>(v->data()) == static_cast<void*>(v + 1));
+        CHECK(!v->is_small() && v->size() == 1);
+
+        vector other(alloc);
+        CHECK(other.is_small());
+        v->swap(other);
+        CHECK(v->is_small() && v->empty());
+        CHECK(!other.is_small() && other.size() == 1 && other[0] == 1);
+        v->swap(other);
+        CHECK(!v->is_small() && (*v)[0] == 1);
+
+        vector moved(std::move(*v));
+        CHECK(v->is_small() && v->empty());
+        CHECK(!moved.is_small() && moved[0] == 1);
+        v->~vector();
+    }
+
+    /// Stateful, and over-aligned: the header of a vector using it has tail
+    /// padding
+    template <typename T>
+    struct alignas(16) aligned_allocator {
+        using value_type = T;
+
+        aligned_allocator() = default;
+        template <typename U>
+        aligned_allocator(const aligned_allocator<U>& other) noexcept
+            : id(other.id)
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            return std::allocator<T>{}.allocate(n);
+        }
+        void deallocate(T* p, size_t n) noexcept
+        {
+            std::allocator<T>{}.deallocate(p, n);
+        }
+
+        friend bool operator==(const aligned_allocator& a,
+                               const aligned_allocator& b) noexcept
+        {
+            return a.id == b.id;
+        }
+        friend bool operator!=(const aligned_allocator& a,
+                               const aligned_allocator& b) noexcept
+        {
+            return a.id != b.id;
+        }
+
+        int id{0};
+    };
+
+    // The inline elements are inside the object, where the base puts them
+    void test_over_aligned_allocator()
+    {
+        using vector = small_vector<char, 4, aligned_allocator<char>>;
+
+        vector v;
+        auto first = reinterpret_cast<const char*>(v.data());
+        auto object = reinterpret_cast<const char*>(&v);
+        CHECK(first >= object &&
+              first + v.capacity() <= object + sizeof(vector));
+        for (char c = 'a'; c != 'e'; ++c) {
+            v.emplace_back(c);
+        }
+        CHECK(v.is_small() && v[0] == 'a' && v[3] == 'd');
+    }
+
+    /// Counts the allocations of all instances
+    template <typename T>
+    struct counting_allocator {
+        using value_type = T;
+
+        static int allocations;
+
+        counting_allocator() = default;
+        template <typename U>
+        counting_allocator(const counting_allocator<U>&) noexcept
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            ++allocations;
+            return std::allocator<T>{}.allocate(n);
+        }
+        void deallocate(T* p, size_t n) noexcept
+        {
+            std::allocator<T>{}.deallocate(p, n);
+        }
+
+        friend bool operator==(const counting_allocator&,
+                               const counting_allocator&) noexcept
+        {
+            return true;
+        }
+        friend bool operator!=(const counting_allocator&,
+                               const counting_allocator&) noexcept
+        {
+            return false;
+        }
+    };
+    template <typename T>
+    int counting_allocator<T>::allocations = 0;
+
+    // Moving inline elements may allocate through the base, which isn't
+    // noexcept, but never between vectors of the same `N`
+    void test_move_assign()
+    {
+        using base = ekutil::small_vector_base<int, counting_allocator<int>>;
+        using small = small_vector<int, 2, counting_allocator<int>>;
+        using large = small_vector<int, 8, counting_allocator<int>>;
+        static_assert(!noexcept(std::declval<base&>() =
+                                    std::declval<base&&>()),
+                      "small_vector_base: noexcept move may allocate");
+        static_assert(noexcept(std::declval<large&>() =
+                                   std::declval<large&&>()),
+                      "small_vector: move isn't noexcept");
+
+        large a{1, 2, 3, 4, 5, 6};
+        small b;
+        static_cast<base&>(b) = std::move(a);
+        CHECK(b.size() == 6 && b[5] == 6 && !b.is_small());
+
+        // Moved from through the base: inline, with no known capacity,
+        // then spilled to a small heap buffer
+        large c{1, 2, 3, 4, 5, 6, 7, 8, 9};
+        large d;
+        static_cast<base&>(d) = std::move(c);
+        c.push_back(1);
+        CHECK(!c.is_small() && c.capacity() < 6);
+
+        large e{1, 2, 3, 4, 5, 6};
+        auto allocations = counting_allocator<int>::allocations;
+        c = std::move(e);
+        CHECK(counting_allocator<int>::allocations == allocations);
+        CHECK(c.is_small() && c.size() == 6 && c[5] == 6);
+    }
+
+    /// Unequal to other instances, and propagated on copy
+    template <typename T>
+    struct propagating_allocator : counting_allocator<T> {
+        using propagate_on_container_copy_assignment = std::true_type;
+
+        propagating_allocator() = default;
+        explicit propagating_allocator(int i) noexcept : id(i) {}
+        template <typename U>
+        propagating_allocator(const propagating_allocator<U>& other) noexcept
+            : id(other.id)
+        {
+        }
+
+        friend bool operator==(const propagating_allocator& a,
+                               const propagating_allocator& b) noexcept
+        {
+            return a.id == b.id;
+        }
+        friend bool operator!=(const propagating_allocator& a,
+                               const propagating_allocator& b) noexcept
+        {
+            return a.id != b.id;
+        }
+
+        int id{0};
+    };
+
+    // Taking over an unequal allocator frees our heap buffer, but a source
+    // that fits stays inline
+    void test_copy_assign_propagating()
+    {
+        using vector = small_vector<int, 4, propagating_allocator<int>>;
+
+        vector a({1, 2, 3, 4, 5, 6}, propagating_allocator<int>(1));
+        vector b({7, 8}, propagating_allocator<int>(2));
+        CHECK(!a.is_small());
+
+        auto allocations = counting_allocator<int>::allocations;
+        a = b;
+        CHECK(counting_allocator<int>::allocations == allocations);
+        CHECK(a.is_small() && a.capacity() == 4);
+        CHECK(a.size() == 2 && a[0] == 7 && a[1] == 8);
+        CHECK(a.get_allocator().id == 2);
+    }
+
+    // size_class_growth uses what the allocator rounds the allocation up
+    // to, and nothing more
+    void test_size_class_growth()
+    {
+        using ekutil::size_class_growth;
+
+        ekutil::slab_pool pool;
+        ekutil::slab_allocator<char> slab(pool);
+        CHECK(size_class_growth::grow(0, 70, 1, slab) == 96);
+        CHECK(size_class_growth::grow(64, 65, 1, slab) == 96);
+        CHECK(size_class_growth::grow(0, 5000, 1, slab) == 5000);
+        CHECK(size_class_growth::grow(0, 70, 1, std::allocator<char>{}) ==
+              70);
+#if EKUTIL_HAS_MMAP
+        ekutil::large_buffer_allocator<char, 4096> large;
+        CHECK(size_class_growth::grow(0, 5000, 1, large) % 4096 == 0);
+        CHECK(size_class_growth::grow(0, 70, 1, large) == 70);
+#endif
+
+        small_vector<int, 2, ekutil::slab_allocator<int>, size_class_growth>
+            v(ekutil::slab_allocator<int>{pool});
+        for (int i = 0; i < 100; ++i) {
+            v.push_back(i);
+            if (!v.is_small()) {
+                auto bytes = v.capacity() * sizeof(int);
+                CHECK(slab.good_size(bytes) == bytes);
+            }
+        }
+        CHECK(v.size() == 100 && v[99] == 99);
+    }
+
+    // The buffer is handed back, when it is the last allocation
+    void test_no_inline_frees_heap()
+    {
+        using vector = small_vector<int, 0, ekutil::arena_allocator<int>>;
+
+        ekutil::monotonic_arena arena(4096);
+        ekutil::arena_allocator<int> alloc(arena);
+        auto mem = arena.allocate(sizeof(vector), alignof(vector));
+        auto v = ::new (mem) vector(alloc);
+        v->push_back(1);
+        auto buffer = static_cast<void*>(v->data());
+        v->~vector();
+        CHECK(arena.allocate(sizeof(int), alignof(int)) == buffer);
+    }
+
+#if EKUTIL_SMALL_VECTOR_STATS
+    // Threads tagging their vectors at once share one record per tag
+    void test_concurrent_tags()
+    {
+        static const char* const tags[] = {"a", "b", "c", "d"};
+        for (auto tag : tags) {
+            std::vector<std::thread> threads;
+            for (int i = 0; i < 8; ++i) {
+                threads.emplace_back([tag] {
+                    small_vector<int, 3> v;
+                    v.tag_stats(tag);
+                    v.push_back(1);
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            int records = 0;
+            ekutil::small_vector_stats::for_each(
+                [&](const ekutil::small_vector_stats& s) {
+                    if (s.tag && std::strcmp(s.tag, tag) == 0) {
+                        ++records;
+                    }
+                });
+            CHECK(records == 1);
+        }
+    }
+#endif
+}  // namespace
+
+int main()
+{
+    test_inline_and_heap();
+    test_no_inline_in_arena();
+    test_no_inline_frees_heap();
+    test_over_aligned_allocator();
+    test_move_assign();
+    test_copy_assign_propagating();
+    test_size_class_growth();
+#if EKUTIL_SMALL_VECTOR_STATS
+    test_concurrent_tags();
+#endif
+}